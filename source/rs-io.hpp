@@ -1,6 +1,7 @@
 #pragma once
 
 #include "rs-io/channel.hpp"
+#include "rs-io/coroutine.hpp"
 #include "rs-io/named-mutex.hpp"
 #include "rs-io/net.hpp"
 #include "rs-io/path.hpp"
@@ -9,5 +10,6 @@
 #include "rs-io/stdio.hpp"
 #include "rs-io/thread-pool.hpp"
 #include "rs-io/time.hpp"
+#include "rs-io/timer-wheel.hpp"
 #include "rs-io/uri.hpp"
 #include "rs-io/version.hpp"
@@ -1,19 +1,435 @@
 #include "rs-io/channel.hpp"
 #include "rs-tl/guard.hpp"
 #include <algorithm>
+#include <climits>
 #include <cstring>
 #include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#ifdef __linux__
+    #include <linux/futex.h>
+    #include <poll.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#ifdef RS_IO_COROUTINES
+    #include "rs-io/thread-pool.hpp"
+    #include <vector>
+#endif
 
 using namespace std::chrono;
 using namespace std::literals;
 
 namespace RS::IO {
 
+    namespace Detail {
+
+        // Shared wakeup for wait_any(), signalled through Channel::notify().
+        // If any of the channels has a native handle, the wait is a poll()
+        // on all of them plus an eventfd, otherwise it is a futex.
+
+        class WaitNotifier {
+        public:
+            Futex futex;
+            int event = -1;
+            void signal() noexcept {
+                #ifdef __linux__
+                    if (event != -1) {
+                        uint64_t one = 1;
+                        [[maybe_unused]] auto rc = ::write(event, &one, sizeof(one));
+                        return;
+                    }
+                #endif
+                futex.wake();
+            }
+        };
+
+    }
+
     // Class Channel
 
     Channel::~Channel() noexcept {
-        if (dispatch_)
-            dispatch_->drop_channel(*this);
+        if (auto d = dispatch_.load())
+            d->drop_channel(*this, false);
+    }
+
+    void Channel::notify() noexcept {
+        if (! watched_.load(std::memory_order_acquire) && ! notifier_.load())
+            return;
+        // Neither wait_any() nor Dispatch will let go of the channel while
+        // notifying_ is nonzero, so the notifier or dispatch can't be
+        // destroyed under us
+        ++notifying_;
+        if (watched_.load())
+            if (auto d = dispatch_.load())
+                d->signal(*this);
+        if (auto n = notifier_.load())
+            n->signal();
+        --notifying_;
+    }
+
+    // Multiple channel wait
+
+    Channel* wait_any(Channel* const* channels, size_t n, Channel::duration timeout) {
+
+        static constexpr Channel::duration min_interval = 1us;
+        static constexpr Channel::duration max_interval = 1ms;
+
+        Detail::WaitNotifier note;
+        size_t registered = 0;
+        auto guard = TL::on_scope_exit([&] {
+            for (size_t i = 0; i < registered; ++i) {
+                if (channels[i]) {
+                    channels[i]->notifier_ = nullptr;
+                    while (channels[i]->notifying_)
+                        std::this_thread::yield();
+                }
+            }
+            #ifdef __linux__
+                if (note.event != -1)
+                    ::close(note.event);
+            #endif
+        });
+
+        // Channels that can't signal are polled, as in Dispatch::run()
+        bool polled = false;
+        #ifdef __linux__
+            std::vector<pollfd> fds;
+        #endif
+        for (size_t i = 0; i < n; ++i) {
+            auto chan = channels[i];
+            if (! chan)
+                continue;
+            if (! chan->is_notifying())
+                polled = true;
+            if (chan->get_handle() != Channel::no_handle) {
+                #ifdef __linux__
+                    fds.push_back({chan->get_handle(), POLLIN, 0});
+                #else
+                    polled = true;
+                #endif
+            }
+        }
+        #ifdef __linux__
+            if (! fds.empty()) {
+                note.event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                if (note.event == -1) {
+                    int err = errno;
+                    throw std::system_error(err, std::generic_category(), "eventfd()");
+                }
+                fds.push_back({note.event, POLLIN, 0});
+            }
+        #endif
+        for (; registered < n; ++registered) {
+            auto chan = channels[registered];
+            Detail::WaitNotifier* expect = nullptr;
+            if (chan && ! chan->notifier_.compare_exchange_strong(expect, &note))
+                throw std::invalid_argument("Channel is already being waited on");
+        }
+
+        auto now = Channel::clock::now();
+        auto deadline = timeout >= Channel::time_point::max() - now ? Channel::time_point::max() : now + timeout;
+        auto interval = min_interval;
+
+        for (;;) {
+
+            // Reset the notifier before polling, so a notification that
+            // arrives in between ends the wait at once
+            auto seen = note.futex.load();
+            #ifdef __linux__
+                if (note.event != -1) {
+                    uint64_t count = 0;
+                    [[maybe_unused]] auto rc = ::read(note.event, &count, sizeof(count));
+                }
+            #endif
+            for (size_t i = 0; i < n; ++i)
+                if (channels[i] && channels[i]->poll())
+                    return channels[i];
+
+            now = Channel::clock::now();
+            if (now >= deadline)
+                return nullptr;
+            auto wake = deadline;
+            for (size_t i = 0; i < n; ++i)
+                if (channels[i])
+                    wake = std::min(wake, channels[i]->deadline());
+            if (polled) {
+                wake = std::min(wake, now + interval);
+                interval = std::min(2 * interval, max_interval);
+            }
+            auto delta = std::clamp(wake - now, Channel::duration(), Channel::duration(1h));
+
+            #ifdef __linux__
+                if (note.event != -1) {
+                    int ms = -1;
+                    if (wake != Channel::time_point::max())
+                        ms = int(std::min(duration_cast<milliseconds>(delta + 999us), milliseconds(INT_MAX)).count());
+                    for (auto& fd: fds)
+                        fd.revents = 0;
+                    ::poll(fds.data(), fds.size(), ms);
+                    continue;
+                }
+            #endif
+            note.futex.wait(seen, delta);
+
+        }
+
+    }
+
+    // Awaitable channel reads
+
+    #ifdef RS_IO_COROUTINES
+
+        namespace Detail {
+
+            // A single background thread services every channel with a
+            // suspended reader. Notifying channels are registered with the
+            // service's notifier, so a write wakes the thread to resume its
+            // reader at once. On Linux the notifier is an eventfd, and the
+            // thread blocks in poll() on that and the native handles of the
+            // channels that have them, as in wait_any(). Other channels, and
+            // channels that are also being waited on elsewhere, are polled
+            // with the same backoff as Dispatch::run(). A coroutine that was
+            // suspended on a thread pool worker is resumed on the same pool,
+            // otherwise on this thread.
+
+            class AsyncReadService {
+            public:
+                static AsyncReadService& get() { static AsyncReadService service; return service; }
+                void add(AsyncRead* reader);
+            private:
+                std::mutex mutex_;
+                std::vector<AsyncRead*> pending_;
+                WaitNotifier note_;
+                bool stop_ = false;
+                std::thread thread_;
+                AsyncReadService();
+                ~AsyncReadService() noexcept;
+                void payload() noexcept;
+                bool attach(Channel& c) noexcept;
+                void release(Channel& c) noexcept;
+                static void resume(AsyncRead* reader) noexcept;
+            };
+
+            AsyncReadService::AsyncReadService() {
+                // Without an eventfd, fall back to the futex and poll the
+                // channels with native handles
+                #ifdef __linux__
+                    note_.event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                #endif
+                thread_ = std::thread([this] { payload(); });
+            }
+
+            AsyncReadService::~AsyncReadService() noexcept {
+                {
+                    std::unique_lock lock(mutex_);
+                    stop_ = true;
+                }
+                note_.signal();
+                thread_.join();
+                #ifdef __linux__
+                    if (note_.event != -1)
+                        ::close(note_.event);
+                #endif
+            }
+
+            void AsyncReadService::add(AsyncRead* reader) {
+                {
+                    std::unique_lock lock(mutex_);
+                    pending_.push_back(reader);
+                }
+                note_.signal();
+            }
+
+            void AsyncReadService::payload() noexcept {
+                static constexpr Channel::duration min_interval = 1us;
+                static constexpr Channel::duration max_interval = 1ms;
+                auto interval = min_interval;
+                std::vector<AsyncRead*> ready;
+                #ifdef __linux__
+                    std::vector<pollfd> fds;
+                #endif
+                for (;;) {
+                    // Reset the notifier before trying the channels, so a
+                    // notification that arrives in between is not lost
+                    auto seen = note_.futex.load();
+                    #ifdef __linux__
+                        if (note_.event != -1) {
+                            uint64_t count = 0;
+                            [[maybe_unused]] auto rc = ::read(note_.event, &count, sizeof(count));
+                        }
+                    #endif
+                    bool polled = false;
+                    auto wake = Channel::time_point::max();
+                    {
+                        std::unique_lock lock(mutex_);
+                        if (stop_)
+                            return;
+                        auto it = std::partition(pending_.begin(), pending_.end(), [] (AsyncRead* r) {
+                            try {
+                                return ! r->try_read();
+                            }
+                            catch (...) {
+                                r->error_ = std::current_exception();
+                                return false;
+                            }
+                        });
+                        ready.assign(it, pending_.end());
+                        pending_.erase(it, pending_.end());
+                        // Deregister before resuming, since the coroutine
+                        // may destroy the channel
+                        for (auto r: ready)
+                            release(r->channel_);
+                        for (auto r: pending_) {
+                            polled |= ! attach(r->channel_);
+                            wake = std::min(wake, r->channel_.deadline());
+                        }
+                        #ifdef __linux__
+                            if (note_.event != -1) {
+                                fds.assign(1, {note_.event, POLLIN, 0});
+                                for (auto r: pending_)
+                                    if (r->channel_.get_handle() != Channel::no_handle)
+                                        fds.push_back({r->channel_.get_handle(), POLLIN, 0});
+                            }
+                        #endif
+                    }
+                    if (! ready.empty()) {
+                        for (auto r: ready)
+                            resume(r);
+                        ready.clear();
+                        interval = min_interval;
+                        continue;
+                    }
+                    auto now = Channel::clock::now();
+                    if (polled) {
+                        wake = std::min(wake, now + interval);
+                        interval = std::min(2 * interval, max_interval);
+                    }
+                    auto delta = std::clamp(wake - now, Channel::duration(), Channel::duration(1h));
+                    #ifdef __linux__
+                        if (note_.event != -1) {
+                            int ms = -1;
+                            if (wake != Channel::time_point::max())
+                                ms = int(duration_cast<milliseconds>(delta + 999us).count());
+                            ::poll(fds.data(), fds.size(), ms);
+                            continue;
+                        }
+                    #endif
+                    note_.futex.wait(seen, delta);
+                }
+            }
+
+            bool AsyncReadService::attach(Channel& c) noexcept {
+                // True if the channel was already registered. One registered
+                // just now must be polled once more, since a write may have
+                // come in after it was last tried; one that wait_any() is
+                // using is polled until that wait ends. Native handles are
+                // only watched when the notifier is an eventfd.
+                if (! c.is_notifying())
+                    return false;
+                if (c.get_handle() != Channel::no_handle && note_.event == -1)
+                    return false;
+                WaitNotifier* expect = nullptr;
+                if (c.notifier_.compare_exchange_strong(expect, &note_))
+                    return false;
+                return expect == &note_;
+            }
+
+            void AsyncReadService::release(Channel& c) noexcept {
+                // Called with the mutex held; the notifier outlives every
+                // channel, so there is no need to wait for notify() to finish
+                if (c.notifier_.load() != &note_)
+                    return;
+                bool shared = std::any_of(pending_.begin(), pending_.end(),
+                    [&c] (AsyncRead* r) { return &r->channel_ == &c; });
+                if (! shared) {
+                    auto expect = &note_;
+                    c.notifier_.compare_exchange_strong(expect, nullptr);
+                }
+            }
+
+            void AsyncReadService::resume(AsyncRead* reader) noexcept {
+                auto handle = reader->handle_;
+                if (reader->pool_) {
+                    try {
+                        reader->pool_->insert([handle] { handle.resume(); });
+                        return;
+                    }
+                    catch (...) {}
+                }
+                handle.resume();
+            }
+
+            void AsyncRead::await_suspend(std::coroutine_handle<> h) {
+                handle_ = h;
+                pool_ = ThreadPool::current();
+                AsyncReadService::get().add(this);
+            }
+
+            SignalRead::SignalRead(MessageChannel<void>& c) noexcept:
+            AsyncRead(c) {}
+
+            bool SignalRead::try_read() {
+                if (! channel_.poll())
+                    return false;
+                closed_ = channel_.is_closed();
+                return true;
+            }
+
+            StreamRead::StreamRead(StreamChannel& c, std::string& dst) noexcept:
+            AsyncRead(c), dst_(dst) {}
+
+            bool StreamRead::try_read() {
+                if (! channel_.poll())
+                    return false;
+                if (channel_.is_closed())
+                    return true;
+                bytes_ = static_cast<StreamChannel&>(channel_).append(dst_);
+                return bytes_ > 0 || channel_.is_closed();
+            }
+
+        }
+
+    #endif
+
+    // Wait primitive for lock free channels
+
+    namespace Detail {
+
+        #ifdef __linux__
+
+            void Futex::wait(uint32_t old, Channel::duration timeout) noexcept {
+                auto ts = duration_cast<nanoseconds>(timeout).count();
+                timespec spec = {time_t(ts / 1'000'000'000), long(ts % 1'000'000'000)};
+                syscall(SYS_futex, &word_, FUTEX_WAIT_PRIVATE, old, &spec, nullptr, 0);
+            }
+
+            void Futex::wake() noexcept {
+                word_.fetch_add(1, std::memory_order_release);
+                syscall(SYS_futex, &word_, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+            }
+
+        #else
+
+            void Futex::wait(uint32_t old, Channel::duration timeout) noexcept {
+                std::unique_lock lock(mutex_);
+                cv_.wait_for(lock, timeout, [&] { return word_.load() != old; });
+            }
+
+            void Futex::wake() noexcept {
+                {
+                    std::unique_lock lock(mutex_);
+                    word_.fetch_add(1, std::memory_order_release);
+                }
+                cv_.notify_all();
+            }
+
+        #endif
+
     }
 
     // Class StreamChannel
@@ -45,10 +461,21 @@ namespace RS::IO {
         next_tick_ = clock::now() + delta_;
     }
 
+    TimerChannel::TimerChannel(TimerWheel& wheel, Channel::duration t, size_t count):
+    TimerChannel(t, count) {
+        wheel_ = &wheel;
+        timer_.set_callback([this] { on_wheel(); });
+        timer_.arm(wheel, duration_cast<TimerWheel::duration>(delta_));
+    }
+
     void TimerChannel::close() noexcept {
-        std::unique_lock lock(mutex_);
-        open_ = false;
-        cv_.notify_all();
+        {
+            std::unique_lock lock(mutex_);
+            open_ = false;
+            cv_.notify_all();
+            notify();
+        }
+        timer_.cancel();
     }
 
     void TimerChannel::flush() noexcept {
@@ -84,6 +511,24 @@ namespace RS::IO {
         return true;
     }
 
+    void TimerChannel::on_wheel() {
+        // The wheel only wakes the dispatcher; ticks are still counted
+        // against the channel's own clock
+        std::unique_lock lock(mutex_);
+        if (! open_)
+            return;
+        auto now = clock::now();
+        auto next = next_tick_;
+        if (next <= now) {
+            notify();
+            if (delta_ > duration())
+                next += delta_ * ((now - next) / delta_ + 1);
+            else
+                next = now;
+        }
+        timer_.arm(*wheel_, duration_cast<TimerWheel::duration>(next - now));
+    }
+
     void TimerChannel::step(size_t n) {
         n = std::min(n, count_);
         count_ -= n;
@@ -91,17 +536,26 @@ namespace RS::IO {
         if (count_ == 0) {
             open_ = false;
             cv_.notify_all();
+            notify();
         }
     }
 
+    Channel::time_point TimerChannel::deadline() const noexcept {
+        std::unique_lock lock(mutex_);
+        if (! open_)
+            return time_point::min();
+        return wheel_ ? time_point::max() : next_tick_;
+    }
+
     // Class BufferChannel
 
     void BufferChannel::close() noexcept {
         std::unique_lock lock(mutex_);
-        buf_.clear();
-        ofs_ = 0;
+        chunks_.clear();
+        ofs_ = size_ = 0;
         open_ = false;
         cv_.notify_all();
+        notify();
     }
 
     size_t BufferChannel::read(void* dst, size_t maxlen) {
@@ -110,48 +564,149 @@ namespace RS::IO {
         std::unique_lock lock(mutex_);
         if (! open_)
             return 0;
-        size_t n = std::min(buf_.size() - ofs_, maxlen);
-        std::memcpy(dst, buf_.data() + ofs_, n);
-        ofs_ += n;
-        if (ofs_ == buf_.size()) {
-            buf_.clear();
-            ofs_ = 0;
-        } else if (2 * ofs_ >= buf_.size()) {
-            buf_.erase(0, ofs_);
-            ofs_ = 0;
+        auto out = static_cast<char*>(dst);
+        size_t n = std::min(size_, maxlen), pos = ofs_, done = 0;
+        for (auto it = chunks_.begin(); done < n; ++it, pos = 0) {
+            size_t k = std::min(it->size() - pos, n - done);
+            std::memcpy(out + done, it->data() + pos, k);
+            done += k;
         }
+        drop_front(n);
         return n;
     }
 
-    bool BufferChannel::write(const void* src, size_t len) {
+    bool BufferChannel::adopt(std::string&& src) {
         std::unique_lock lock(mutex_);
         if (! open_)
             return false;
-        buf_.append(static_cast<const char*>(src), len);
-        if (ofs_ < buf_.size())
-            cv_.notify_all();
+        if (src.empty())
+            return true;
+        size_ += src.size();
+        if (! chunks_.empty() && chunks_.back().capacity() - chunks_.back().size() >= src.size())
+            chunks_.back() += src;
+        else
+            chunks_.push_back(std::move(src));
+        cv_.notify_all();
+        notify();
         return true;
     }
 
     void BufferChannel::clear() noexcept {
         std::unique_lock lock(mutex_);
-        buf_.clear();
-        ofs_ = 0;
+        chunks_.clear();
+        ofs_ = size_ = 0;
+    }
+
+    size_t BufferChannel::consume(size_t n) noexcept {
+        std::unique_lock lock(mutex_);
+        n = std::min(n, size_);
+        drop_front(n);
+        return n;
+    }
+
+    std::vector<std::string_view> BufferChannel::peek(size_t maxlen) const {
+        std::vector<std::string_view> views;
+        std::unique_lock lock(mutex_);
+        size_t pos = ofs_, left = std::min(size_, maxlen);
+        for (auto it = chunks_.begin(); left > 0; ++it, pos = 0) {
+            size_t k = std::min(it->size() - pos, left);
+            views.emplace_back(it->data() + pos, k);
+            left -= k;
+        }
+        return views;
+    }
+
+    size_t BufferChannel::size() const noexcept {
+        std::unique_lock lock(mutex_);
+        return size_;
+    }
+
+    bool BufferChannel::writev(const std::string_view* src, size_t n) {
+        std::unique_lock lock(mutex_);
+        if (! open_)
+            return false;
+        size_t total = 0;
+        for (size_t i = 0; i < n; ++i)
+            total += src[i].size();
+        if (total == 0)
+            return true;
+        // Appending within the reserved capacity leaves existing bytes in place
+        if (chunks_.empty() || chunks_.back().capacity() - chunks_.back().size() < total) {
+            chunks_.emplace_back();
+            chunks_.back().reserve(std::max(total, chunk_size));
+        }
+        auto& back = chunks_.back();
+        for (size_t i = 0; i < n; ++i)
+            back.append(src[i]);
+        size_ += total;
+        cv_.notify_all();
+        notify();
+        return true;
     }
 
     bool BufferChannel::do_wait_for(duration t) {
         std::unique_lock lock(mutex_);
-        if (open_ && ofs_ == buf_.size() && t > duration())
-            cv_.wait_for(lock, t, [&] { return ! open_ || ofs_ < buf_.size(); });
-        return ! open_ || ofs_ < buf_.size();
+        if (open_ && size_ == 0 && t > duration())
+            cv_.wait_for(lock, t, [&] { return ! open_ || size_ > 0; });
+        return ! open_ || size_ > 0;
+    }
+
+    void BufferChannel::drop_front(size_t n) noexcept {
+        size_ -= n;
+        while (n > 0) {
+            size_t k = std::min(chunks_.front().size() - ofs_, n);
+            ofs_ += k;
+            n -= k;
+            if (ofs_ == chunks_.front().size()) {
+                if (chunks_.size() == 1) {
+                    chunks_.front().clear();
+                } else {
+                    chunks_.pop_front();
+                }
+                ofs_ = 0;
+            }
+        }
     }
 
     // Class Dispatch
 
+    Dispatch::Dispatch(mode m):
+    mode_(m) {
+        #ifdef __linux__
+            if (mode_ == mode::reactor) {
+                epoll_ = epoll_create1(EPOLL_CLOEXEC);
+                if (epoll_ == -1)
+                    throw std::system_error(errno, std::generic_category(), "epoll_create1()");
+                event_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                if (event_ == -1) {
+                    int err = errno;
+                    ::close(epoll_);
+                    throw std::system_error(err, std::generic_category(), "eventfd()");
+                }
+                epoll_event ev = {};
+                ev.events = EPOLLIN;
+                ev.data.ptr = nullptr;
+                epoll_ctl(epoll_, EPOLL_CTL_ADD, event_, &ev);
+            }
+        #else
+            mode_ = mode::threads;
+        #endif
+    }
+
     Dispatch::~Dispatch() noexcept {
         stop();
-        for (auto& [chan,task]: tasks_)
+        for (auto& [chan,task]: tasks_) {
             chan->dispatch_ = nullptr;
+            chan->watched_ = false;
+            while (chan->notifying_)
+                std::this_thread::yield();
+        }
+        #ifdef __linux__
+            if (event_ != -1)
+                ::close(event_);
+            if (epoll_ != -1)
+                ::close(epoll_);
+        #endif
     }
 
     Dispatch::result Dispatch::run() noexcept {
@@ -163,40 +718,61 @@ namespace RS::IO {
         int waits = 0;
         for (;;) {
             int calls = 0;
-            for (auto& [chan,task]: tasks_) {
-                if (chan->is_synchronous()) {
-                    try {
-                        if (chan->poll()) {
-                            if (chan->is_closed()) {
-                                set_fault(*chan);
-                                break;
+            if (polled_ > 0) {
+                for (auto& [chan,task]: tasks_) {
+                    if (task->type == kind::polled) {
+                        try {
+                            if (chan->poll()) {
+                                if (chan->is_closed()) {
+                                    set_fault(*chan);
+                                    break;
+                                }
+                                task->handler();
+                                ++calls;
                             }
-                            task->handler();
-                            ++calls;
                         }
-                    }
-                    catch (...) {
-                        set_fault(*chan, std::current_exception());
-                        break;
+                        catch (...) {
+                            set_fault(*chan, std::current_exception());
+                            break;
+                        }
                     }
                 }
             }
-            {
-                std::unique_lock lock(faults_mutex_);
-                if (! faults_.empty()) {
-                    auto fault = faults_.front();
-                    faults_.pop_front();
-                    if (fault.channel)
-                        drop_channel(*fault.channel);
-                    return fault;
-                }
+            if (mode_ == mode::reactor && waits == 0)
+                collect({});
+            calls += run_pending();
+            std::unique_lock lock(faults_mutex_);
+            if (! faults_.empty()) {
+                auto fault = faults_.front();
+                faults_.pop_front();
+                lock.unlock();
+                if (fault.channel)
+                    drop_channel(*fault.channel);
+                return fault;
             }
+            lock.unlock();
             if (calls == 0) {
-                if (++waits == 1)
-                    interval = min_interval;
-                else
-                    interval = std::min(2 * interval, max_interval);
-                std::this_thread::sleep_for(interval);
+                // Channels that can't signal are still polled, but the wait
+                // ends as soon as anything else happens
+                auto timeout = Channel::duration::max();
+                if (polled_ > 0) {
+                    if (++waits == 1)
+                        interval = min_interval;
+                    else
+                        interval = std::min(2 * interval, max_interval);
+                    timeout = interval;
+                } else {
+                    ++waits;
+                }
+                if (! wheel_.empty())
+                    timeout = std::min(timeout, duration_cast<Channel::duration>(wheel_.next_timeout()));
+                auto now = Channel::clock::now();
+                for (auto chan: timed_) {
+                    auto t = chan->deadline();
+                    if (t != Channel::time_point::max())
+                        timeout = std::min(timeout, std::max(t - now, Channel::duration()));
+                }
+                collect(timeout);
             } else {
                 waits = 0;
                 std::this_thread::yield();
@@ -211,14 +787,33 @@ namespace RS::IO {
             run();
     }
 
-    void Dispatch::add_channel(Channel& c, std::function<void()> f) {
+    void Dispatch::add_channel(Channel& c, std::function<void()> f, executor_ptr ex) {
         if (tasks_.count(&c))
             throw std::invalid_argument("Duplicate channel in dispatch set");
         auto task_ptr = std::make_unique<task_info>();
         auto& task = *task_ptr;
         task.handler = f;
+        task.executor = std::move(ex);
+        if (c.is_notifying() && mode_ == mode::reactor && c.get_handle() != Channel::no_handle)
+            task.type = kind::handle;
+        else if (c.is_notifying() && (mode_ == mode::reactor || c.is_synchronous() || on_wheel(c)))
+            task.type = kind::notify;
+        else if (c.is_synchronous())
+            task.type = kind::polled;
+        else
+            task.type = kind::thread;
+        #ifdef __linux__
+            if (task.type == kind::handle) {
+                task.handle = c.get_handle();
+                epoll_event ev = {};
+                ev.events = EPOLLIN;
+                ev.data.ptr = &c;
+                if (epoll_ctl(epoll_, EPOLL_CTL_ADD, task.handle, &ev) == -1)
+                    throw std::system_error(errno, std::generic_category(), "epoll_ctl()");
+            }
+        #endif
         tasks_[&c] = std::move(task_ptr);
-        if (! c.is_synchronous()) {
+        if (task.type == kind::thread) {
             task.thread = TL::Thread([&] () noexcept {
                 try {
                     for (;;) {
@@ -234,19 +829,261 @@ namespace RS::IO {
                     set_fault(c, std::current_exception());
                 }
             });
+        } else if (task.type == kind::polled) {
+            ++polled_;
+        } else {
+            if (c.deadline() != Channel::time_point::max())
+                timed_.push_back(&c);
+            ready_.push_back(&c);
+            c.watched_ = true;
         }
         c.dispatch_ = this;
     }
 
-    void Dispatch::drop_channel(Channel& c) noexcept {
-        tasks_.erase(&c);
+    void Dispatch::drop_channel(Channel& c, [[maybe_unused]] bool live) noexcept {
+        auto it = tasks_.find(&c);
+        if (it == tasks_.end())
+            return;
+        #ifdef __linux__
+            // A closed channel's handle has already left the epoll set, and
+            // its number may since have been reused by another channel.
+            auto& task = *it->second;
+            if (task.type == kind::handle) {
+                bool registered;
+                if (live)
+                    registered = ! c.is_closed() && c.get_handle() == task.handle;
+                else
+                    registered = std::none_of(tasks_.begin(), tasks_.end(), [&] (auto& pair) {
+                        return pair.first != &c && pair.second->type == kind::handle && pair.second->handle == task.handle;
+                    });
+                if (registered)
+                    epoll_ctl(epoll_, EPOLL_CTL_DEL, task.handle, nullptr);
+            }
+        #endif
+        if (it->second->type == kind::polled)
+            --polled_;
+        ready_.erase(std::remove(ready_.begin(), ready_.end(), &c), ready_.end());
+        timed_.erase(std::remove(timed_.begin(), timed_.end(), &c), timed_.end());
+        auto ex = it->second->executor;
+        tasks_.erase(it); // Joins the reading thread, if any
         c.dispatch_ = nullptr;
+        c.watched_ = false;
+        // A producer may still be inside notify(), about to signal us
+        while (c.notifying_)
+            std::this_thread::yield();
+        c.signal_pending_ = false;
+        if (ex) {
+            {
+                std::unique_lock lock(ex->mutex);
+                ex->idle.wait(lock, [&] { return ex->active == 0; });
+            }
+            // The reading side may also have seen the channel close after a
+            // handler failed
+            std::unique_lock lock(faults_mutex_);
+            faults_.erase(std::remove_if(faults_.begin(), faults_.end(),
+                [&c] (auto& r) { return r.channel == &c; }), faults_.end());
+        }
     }
 
     void Dispatch::set_fault(Channel& c, std::exception_ptr e) {
-        std::unique_lock lock(faults_mutex_);
-        faults_.push_back({&c, e});
+        {
+            std::unique_lock lock(faults_mutex_);
+            faults_.push_back({&c, e});
+        }
         c.close();
+        wake();
+    }
+
+    void Dispatch::collect(Channel::duration timeout) {
+        if (! ready_.empty())
+            timeout = {};
+        #ifdef __linux__
+            if (mode_ == mode::reactor) {
+                static constexpr int max_events = 64;
+                // Waits shorter than epoll's resolution are polled
+                int ms = -1;
+                if (timeout < 1ms)
+                    ms = 0;
+                else if (timeout != Channel::duration::max())
+                    ms = int(std::min(duration_cast<milliseconds>(timeout + 999us), milliseconds(INT_MAX)).count());
+                epoll_event events[max_events];
+                int n = epoll_wait(epoll_, events, max_events, ms);
+                if (n == 0 && timeout > Channel::duration() && timeout < 1ms)
+                    std::this_thread::sleep_for(timeout);
+                for (int i = 0; i < n; ++i) {
+                    if (events[i].data.ptr) {
+                        ready_.push_back(static_cast<Channel*>(events[i].data.ptr));
+                    } else {
+                        uint64_t count = 0;
+                        [[maybe_unused]] auto rc = ::read(event_, &count, sizeof(count));
+                    }
+                }
+                return;
+            }
+        #endif
+        if (timeout == Channel::duration())
+            return;
+        std::unique_lock lock(signal_mutex_);
+        if (timeout == Channel::duration::max())
+            signal_cv_.wait(lock, [&] { return woken_; });
+        else
+            signal_cv_.wait_for(lock, timeout, [&] { return woken_; });
+        woken_ = false;
+    }
+
+    int Dispatch::run_pending() {
+        if (! wheel_.empty())
+            wheel_.advance();
+        std::deque<Channel*> pending;
+        pending.swap(ready_);
+        {
+            std::unique_lock lock(signal_mutex_);
+            pending.insert(pending.end(), signalled_.begin(), signalled_.end());
+            signalled_.clear();
+        }
+        if (! timed_.empty()) {
+            auto now = Channel::clock::now();
+            for (auto chan: timed_)
+                if (chan->deadline() <= now)
+                    pending.push_back(chan);
+        }
+        int calls = 0;
+        for (auto chan: pending) {
+            auto it = tasks_.find(chan);
+            if (it != tasks_.end())
+                calls += service(*chan, *it->second);
+        }
+        return calls;
+    }
+
+    bool Dispatch::service(Channel& c, task_info& task) {
+        static constexpr int max_calls = 16;
+        // Cleared before polling, so a notification that arrives after the
+        // last poll queues the channel again
+        c.signal_pending_.exchange(false);
+        if (task.done || (task.type != kind::handle && task.type != kind::notify))
+            return false;
+        int calls = 0;
+        try {
+            for (; calls < max_calls; ++calls) {
+                if (! c.poll())
+                    return calls > 0;
+                if (c.is_closed()) {
+                    task.done = true;
+                    set_fault(c);
+                    return true;
+                }
+                task.handler();
+            }
+            ready_.push_back(&c);
+        }
+        catch (...) {
+            task.done = true;
+            set_fault(c, std::current_exception());
+        }
+        return true;
+    }
+
+    void Dispatch::signal(Channel& c) noexcept {
+        // Only queue the channel once until service() picks it up
+        if (c.signal_pending_.exchange(true))
+            return;
+        bool first = false;
+        {
+            std::unique_lock lock(signal_mutex_);
+            first = signalled_.empty();
+            signalled_.push_back(&c);
+        }
+        if (first)
+            wake();
+    }
+
+    void Dispatch::wake() noexcept {
+        #ifdef __linux__
+            if (mode_ == mode::reactor) {
+                uint64_t one = 1;
+                [[maybe_unused]] auto rc = ::write(event_, &one, sizeof(one));
+                return;
+            }
+        #endif
+        {
+            std::unique_lock lock(signal_mutex_);
+            woken_ = true;
+        }
+        signal_cv_.notify_one();
+    }
+
+    Dispatch::executor_ptr Dispatch::make_executor(ThreadPool& pool, order o) {
+        auto ex = std::make_shared<executor_info>();
+        if (o == order::serial) {
+            ex->own_strand = std::make_unique<Strand>(pool);
+            ex->strand = ex->own_strand.get();
+        } else {
+            ex->pool = &pool;
+        }
+        return ex;
+    }
+
+    Dispatch::executor_ptr Dispatch::make_executor(Strand& strand) {
+        auto ex = std::make_shared<executor_info>();
+        ex->strand = &strand;
+        return ex;
+    }
+
+    // Holds a raw executor pointer, not a shared pointer, because the last
+    // reference must not be released inside the strand that it owns. The
+    // active count is taken on construction and released under the
+    // executor's mutex on destruction, whether or not the job was run, so a
+    // job discarded by the pool or strand can't leave drop_channel() waiting
+    // forever, and the executor can't go away while the job still uses it.
+
+    struct Dispatch::pool_job {
+        Dispatch* disp;
+        Channel* chan;
+        executor_info* ex;
+        Detail::PoolTask task;
+        pool_job(Dispatch& d, Channel& c, executor_info& e, Detail::PoolTask t) noexcept:
+        disp(&d), chan(&c), ex(&e), task(std::move(t)) { ++ex->active; }
+        ~pool_job() noexcept;
+        pool_job(const pool_job&) = delete;
+        pool_job(pool_job&& j) noexcept:
+        disp(j.disp), chan(j.chan), ex(std::exchange(j.ex, nullptr)), task(std::move(j.task)) {}
+        pool_job& operator=(const pool_job&) = delete;
+        pool_job& operator=(pool_job&&) = delete;
+        void operator()() noexcept;
+    };
+
+    Dispatch::pool_job::~pool_job() noexcept {
+        if (! ex)
+            return;
+        task.reset();
+        std::unique_lock lock(ex->mutex);
+        if (--ex->active == 0)
+            ex->idle.notify_all();
+    }
+
+    void Dispatch::pool_job::operator()() noexcept {
+        try {
+            task();
+        }
+        catch (...) {
+            if (! ex->faulted.exchange(true))
+                disp->set_fault(*chan, std::current_exception());
+        }
+        task.reset();
+    }
+
+    void Dispatch::post(const executor_ptr& ex, Channel& c, Detail::PoolTask job) {
+        pool_job pj(*this, c, *ex, std::move(job));
+        if (ex->strand)
+            ex->strand->insert(std::move(pj));
+        else
+            ex->pool->insert(std::move(pj));
+    }
+
+    bool Dispatch::on_wheel(Channel& c) const noexcept {
+        auto timer = dynamic_cast<TimerChannel*>(&c);
+        return timer && timer->wheel() == &wheel_;
     }
 
 }
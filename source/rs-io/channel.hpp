@@ -1,22 +1,36 @@
 #pragma once
 
+#include "rs-io/thread-pool.hpp"
 #include "rs-io/time.hpp"
+#include "rs-io/timer-wheel.hpp"
 #include "rs-io/utility.hpp"
 #include "rs-tl/thread.hpp"
 #include "rs-tl/time.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <exception>
 #include <functional>
+#include <initializer_list>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+#ifdef RS_IO_COROUTINES
+    #include <coroutine>
+#endif
 
 namespace RS::IO {
 
@@ -24,16 +38,24 @@ namespace RS::IO {
 
     // Forward declarations
 
+    template <typename T> class BoundedQueueChannel;
+    template <typename T> class BroadcastChannel;
     class BufferChannel;
     class Channel;
     class Dispatch;
     template <typename T> class GeneratorChannel;
     template <typename T> class MessageChannel;
     template <typename T> class QueueChannel;
+    template <typename T> class SpscQueueChannel;
     class StreamChannel;
     class TimerChannel;
     template <typename T> class ValueChannel;
 
+    namespace Detail {
+        class AsyncReadService;
+        class WaitNotifier;
+    }
+
     // Channel base class
 
     class Channel:
@@ -55,22 +77,120 @@ namespace RS::IO {
 
         #ifdef _XOPEN_SOURCE
             using native_handle = int; // file handle
+            static constexpr native_handle no_handle = -1;
         #else
             using native_handle = void*; // HANDLE
+            static constexpr native_handle no_handle = nullptr;
         #endif
 
         Channel() = default;
 
-        virtual native_handle get_handle() const noexcept { return {}; }
+        virtual native_handle get_handle() const noexcept { return no_handle; }
+        virtual bool is_notifying() const noexcept { return false; }
+        virtual time_point deadline() const noexcept { return time_point::max(); }
+        void notify() noexcept;
 
     private:
 
         friend class Dispatch;
+        friend class Detail::AsyncReadService;
+        friend Channel* wait_any(Channel* const* channels, size_t n, duration timeout);
 
-        Dispatch* dispatch_ = nullptr;
+        std::atomic<Dispatch*> dispatch_ {nullptr};
+        std::atomic<bool> watched_ {false};
+        std::atomic<bool> signal_pending_ {false};
+        std::atomic<Detail::WaitNotifier*> notifier_ {nullptr};
+        std::atomic<int> notifying_ {0};
 
     };
 
+    // Multiple channel wait
+
+    Channel* wait_any(Channel* const* channels, size_t n, Channel::duration timeout = Channel::duration::max());
+    inline Channel* wait_any(std::initializer_list<Channel*> channels, Channel::duration timeout = Channel::duration::max())
+        { return wait_any(channels.begin(), channels.size(), timeout); }
+    inline Channel* wait_any(const std::vector<Channel*>& channels, Channel::duration timeout = Channel::duration::max())
+        { return wait_any(channels.data(), channels.size(), timeout); }
+
+    // Awaitable channel reads
+
+    #ifdef RS_IO_COROUTINES
+
+        namespace Detail {
+
+            class AsyncRead {
+            public:
+                AsyncRead(const AsyncRead&) = delete;
+                AsyncRead(AsyncRead&&) = delete;
+                AsyncRead& operator=(const AsyncRead&) = delete;
+                AsyncRead& operator=(AsyncRead&&) = delete;
+                bool await_ready() { return try_read(); }
+                void await_suspend(std::coroutine_handle<> h);
+            protected:
+                Channel& channel_;
+                explicit AsyncRead(Channel& c) noexcept: channel_(c) {}
+                virtual ~AsyncRead() noexcept = default;
+                virtual bool try_read() = 0; // True if done (read or closed)
+                void check_error() const { if (error_) std::rethrow_exception(error_); }
+            private:
+                friend class AsyncReadService;
+                std::coroutine_handle<> handle_;
+                ThreadPool* pool_ = nullptr;
+                std::exception_ptr error_;
+            };
+
+            template <typename T>
+            class MessageRead:
+            public AsyncRead {
+            public:
+                explicit MessageRead(MessageChannel<T>& c) noexcept: AsyncRead(c) {}
+                std::optional<T> await_resume() { check_error(); return std::move(value_); }
+            protected:
+                bool try_read() override;
+            private:
+                std::optional<T> value_;
+            };
+
+                template <typename T>
+                bool MessageRead<T>::try_read() {
+                    if (! channel_.poll())
+                        return false;
+                    if (channel_.is_closed())
+                        return true;
+                    T t;
+                    if (! static_cast<MessageChannel<T>&>(channel_).read(t))
+                        return channel_.is_closed();
+                    value_ = std::move(t);
+                    return true;
+                }
+
+            class SignalRead:
+            public AsyncRead {
+            public:
+                explicit SignalRead(MessageChannel<void>& c) noexcept;
+                bool await_resume() { check_error(); return ! closed_; }
+            protected:
+                bool try_read() override;
+            private:
+                bool closed_ = false;
+            };
+
+            class StreamRead:
+            public AsyncRead {
+            public:
+                StreamRead(StreamChannel& c, std::string& dst) noexcept;
+                size_t await_resume() { check_error(); return bytes_; }
+            protected:
+                bool try_read() override;
+            private:
+                std::string& dst_;
+                size_t bytes_ = 0;
+            };
+
+        }
+
+    #endif
+
     // Intermediate base classes
 
     template <typename T>
@@ -80,6 +200,9 @@ namespace RS::IO {
         using value_type = T;
         virtual bool read(T& t) = 0;
         std::optional<T> read_maybe() { T t; if (read(t)) return t; else return {}; }
+        #ifdef RS_IO_COROUTINES
+            Detail::MessageRead<T> async_read() noexcept { return Detail::MessageRead<T>(*this); }
+        #endif
     protected:
         MessageChannel() = default;
     };
@@ -89,6 +212,9 @@ namespace RS::IO {
     public Channel {
     public:
         using value_type = void;
+        #ifdef RS_IO_COROUTINES
+            Detail::SignalRead async_read() noexcept { return Detail::SignalRead(*this); }
+        #endif
     protected:
         MessageChannel() = default;
     };
@@ -99,6 +225,9 @@ namespace RS::IO {
         static constexpr size_t default_block_size = 65536;
         virtual size_t read(void* dst, size_t maxlen) = 0;
         size_t append(std::string& dst);
+        #ifdef RS_IO_COROUTINES
+            Detail::StreamRead async_read(std::string& dst) noexcept { return Detail::StreamRead(*this, dst); }
+        #endif
         size_t block_size() const noexcept { return block_; }
         std::string read_all();
         void set_block_size(size_t n) noexcept { block_ = n; }
@@ -108,12 +237,37 @@ namespace RS::IO {
         size_t block_ = default_block_size;
     };
 
+    // Wait primitive for lock free channels
+
+    namespace Detail {
+
+        // Futex on Linux, condition variable elsewhere
+
+        class Futex {
+        public:
+            Futex() = default;
+            Futex(const Futex&) = delete;
+            Futex& operator=(const Futex&) = delete;
+            uint32_t load() const noexcept { return word_.load(std::memory_order_acquire); }
+            void wait(uint32_t old, Channel::duration timeout) noexcept;
+            void wake() noexcept;
+        private:
+            std::atomic<uint32_t> word_ {0};
+            #ifndef __linux__
+                std::mutex mutex_;
+                std::condition_variable cv_;
+            #endif
+        };
+
+    }
+
     // Concrete channel classes
 
     class TimerChannel:
     public MessageChannel<void> {
     public:
         explicit TimerChannel(Channel::duration t, size_t count = npos) noexcept;
+        TimerChannel(TimerWheel& wheel, Channel::duration t, size_t count = npos);
         TimerChannel(const TimerChannel&) = delete;
         TimerChannel(TimerChannel&&) = delete;
         TimerChannel& operator=(const TimerChannel&) = delete;
@@ -123,8 +277,11 @@ namespace RS::IO {
         void flush() noexcept;
         duration interval() const noexcept { return delta_; }
         auto next() const noexcept { return next_tick_; }
+        TimerWheel* wheel() const noexcept { return wheel_; }
     protected:
         bool do_wait_for(duration t) override;
+        bool is_notifying() const noexcept override { return true; }
+        time_point deadline() const noexcept override;
     private:
         mutable std::mutex mutex_;
         std::condition_variable cv_;
@@ -132,6 +289,9 @@ namespace RS::IO {
         size_t count_;
         duration delta_;
         bool open_ = true;
+        TimerWheel* wheel_ = nullptr;
+        TimerWheel::timer timer_;
+        void on_wheel();
         void step(size_t n = 1);
     };
 
@@ -150,6 +310,7 @@ namespace RS::IO {
         bool read(T& t) override;
     protected:
         bool do_wait_for(Channel::duration /*t*/) override { return true; }
+        bool is_notifying() const noexcept override { return true; }
     private:
         std::mutex mutex_;
         generator gen_;
@@ -159,6 +320,7 @@ namespace RS::IO {
         void GeneratorChannel<T>::close() noexcept {
             std::unique_lock lock(mutex_);
             gen_ = nullptr;
+            this->notify();
         }
 
         template <typename T>
@@ -181,11 +343,14 @@ namespace RS::IO {
         void close() noexcept override;
         bool is_closed() const noexcept override { return ! open_; }
         bool read(T& t) override;
+        template <typename OutputIterator> size_t read_batch(OutputIterator out, size_t max = npos);
         void clear() noexcept;
         bool write(const T& t);
         bool write(T&& t);
+        template <typename Range> bool write_batch(Range&& range);
     protected:
         bool do_wait_for(Channel::duration t) override;
+        bool is_notifying() const noexcept override { return true; }
     private:
         std::mutex mutex_;
         std::condition_variable cv_;
@@ -198,6 +363,7 @@ namespace RS::IO {
             std::unique_lock lock(mutex_);
             open_ = false;
             cv_.notify_all();
+            this->notify();
         }
 
         template <typename T>
@@ -205,13 +371,28 @@ namespace RS::IO {
             std::unique_lock lock(mutex_);
             if (! open_ || queue_.empty())
                 return false;
-            t = queue_.front();
+            t = std::move(queue_.front());
             queue_.pop_front();
             if (! queue_.empty())
                 cv_.notify_all();
             return true;
         }
 
+        template <typename T>
+        template <typename OutputIterator>
+        size_t QueueChannel<T>::read_batch(OutputIterator out, size_t max) {
+            std::unique_lock lock(mutex_);
+            if (! open_)
+                return 0;
+            size_t n = std::min(max, queue_.size());
+            auto end = queue_.begin() + n;
+            std::move(queue_.begin(), end, out);
+            queue_.erase(queue_.begin(), end);
+            if (! queue_.empty())
+                cv_.notify_all();
+            return n;
+        }
+
         template <typename T>
         void QueueChannel<T>::clear() noexcept {
             std::unique_lock lock(mutex_);
@@ -225,6 +406,7 @@ namespace RS::IO {
                 return false;
             queue_.push_back(t);
             cv_.notify_all();
+            this->notify();
             return true;
         }
 
@@ -235,6 +417,27 @@ namespace RS::IO {
                 return false;
             queue_.push_back(std::move(t));
             cv_.notify_all();
+            this->notify();
+            return true;
+        }
+
+        template <typename T>
+        template <typename Range>
+        bool QueueChannel<T>::write_batch(Range&& range) {
+            std::unique_lock lock(mutex_);
+            if (! open_)
+                return false;
+            size_t n = queue_.size();
+            for (auto& t: range) {
+                if constexpr (std::is_rvalue_reference_v<Range&&>)
+                    queue_.push_back(std::move(t));
+                else
+                    queue_.push_back(t);
+            }
+            if (queue_.size() > n) {
+                cv_.notify_all();
+                this->notify();
+            }
             return true;
         }
 
@@ -246,6 +449,642 @@ namespace RS::IO {
             return ! open_ || ! queue_.empty();
         }
 
+    template <typename T>
+    class BoundedQueueChannel:
+    public MessageChannel<T> {
+    public:
+        explicit BoundedQueueChannel(size_t capacity);
+        ~BoundedQueueChannel() noexcept override { clear(); }
+        BoundedQueueChannel(const BoundedQueueChannel&) = delete;
+        BoundedQueueChannel(BoundedQueueChannel&&) = delete;
+        BoundedQueueChannel& operator=(const BoundedQueueChannel&) = delete;
+        BoundedQueueChannel& operator=(BoundedQueueChannel&&) = delete;
+        void close() noexcept override;
+        bool is_closed() const noexcept override { return ! open_; }
+        bool read(T& t) override;
+        size_t capacity() const noexcept { return mask_ + 1; }
+        void clear() noexcept;
+        bool empty() const noexcept { return size() == 0; }
+        size_t size() const noexcept;
+        bool try_write(const T& t) { return do_write(t, {}); }
+        bool try_write(T&& t) { return do_write(std::move(t), {}); }
+        bool write(const T& t) { return do_write(t, Channel::duration::max()); }
+        bool write(T&& t) { return do_write(std::move(t), Channel::duration::max()); }
+        bool write_for(const T& t, Channel::duration timeout) { return do_write(t, timeout); }
+        bool write_for(T&& t, Channel::duration timeout) { return do_write(std::move(t), timeout); }
+    protected:
+        bool do_wait_for(Channel::duration t) override;
+        bool is_notifying() const noexcept override { return true; }
+    private:
+        struct cell {
+            std::atomic<size_t> seq;
+            bool skipped = false; // Writer threw, no value here
+            alignas(T) unsigned char data[sizeof(T)];
+        };
+        static constexpr int spin_count = 64;
+        std::unique_ptr<cell[]> cells_;
+        size_t mask_;
+        alignas(64) std::atomic<size_t> head_ {0};
+        alignas(64) std::atomic<size_t> tail_ {0};
+        alignas(64) std::atomic<bool> open_ {true};
+        std::atomic<int> readers_waiting_ {0};
+        std::atomic<int> writers_waiting_ {0};
+        std::mutex mutex_;
+        std::condition_variable read_cv_;
+        std::condition_variable write_cv_;
+        bool has_data() const noexcept;
+        bool has_space() const noexcept;
+        bool pop(T& t);
+        template <typename U> bool push(U&& u);
+        template <typename U> bool do_write(U&& u, Channel::duration timeout);
+    };
+
+        template <typename T>
+        BoundedQueueChannel<T>::BoundedQueueChannel(size_t capacity) {
+            size_t n = 2;
+            while (n < capacity)
+                n *= 2;
+            cells_ = std::make_unique<cell[]>(n);
+            mask_ = n - 1;
+            for (size_t i = 0; i < n; ++i)
+                cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        template <typename T>
+        void BoundedQueueChannel<T>::close() noexcept {
+            if (! open_.exchange(false))
+                return;
+            {
+                std::unique_lock lock(mutex_);
+                read_cv_.notify_all();
+                write_cv_.notify_all();
+            }
+            this->notify();
+        }
+
+        template <typename T>
+        bool BoundedQueueChannel<T>::read(T& t) {
+            if (! open_ || ! pop(t))
+                return false;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (writers_waiting_ > 0) {
+                std::unique_lock lock(mutex_);
+                write_cv_.notify_one();
+            }
+            return true;
+        }
+
+        template <typename T>
+        void BoundedQueueChannel<T>::clear() noexcept {
+            T t;
+            while (pop(t)) {}
+            if (writers_waiting_ > 0) {
+                std::unique_lock lock(mutex_);
+                write_cv_.notify_all();
+            }
+        }
+
+        template <typename T>
+        size_t BoundedQueueChannel<T>::size() const noexcept {
+            auto tail = tail_.load(std::memory_order_acquire);
+            auto head = head_.load(std::memory_order_acquire);
+            return head < tail ? tail - head : 0;
+        }
+
+        template <typename T>
+        bool BoundedQueueChannel<T>::do_wait_for(Channel::duration t) {
+            if (! open_ || has_data())
+                return true;
+            if (t <= Channel::duration())
+                return false;
+            for (int i = 0; i < spin_count; ++i) {
+                std::this_thread::yield();
+                if (! open_ || has_data())
+                    return true;
+            }
+            ++readers_waiting_;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            {
+                std::unique_lock lock(mutex_);
+                read_cv_.wait_for(lock, t, [&] { return ! open_ || has_data(); });
+            }
+            --readers_waiting_;
+            return ! open_ || has_data();
+        }
+
+        template <typename T>
+        bool BoundedQueueChannel<T>::has_data() const noexcept {
+            auto pos = head_.load(std::memory_order_relaxed);
+            auto seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+            return seq == pos + 1;
+        }
+
+        template <typename T>
+        bool BoundedQueueChannel<T>::has_space() const noexcept {
+            auto pos = tail_.load(std::memory_order_relaxed);
+            auto seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+            return seq == pos;
+        }
+
+        template <typename T>
+        bool BoundedQueueChannel<T>::pop(T& t) {
+            auto pos = head_.load(std::memory_order_relaxed);
+            cell* c;
+            for (;;) {
+                c = &cells_[pos & mask_];
+                auto seq = c->seq.load(std::memory_order_acquire);
+                auto diff = ptrdiff_t(seq) - ptrdiff_t(pos + 1);
+                if (diff == 0) {
+                    if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        if (! c->skipped)
+                            break;
+                        c->skipped = false;
+                        c->seq.store(pos + mask_ + 1, std::memory_order_release);
+                        std::atomic_thread_fence(std::memory_order_seq_cst);
+                        if (writers_waiting_ > 0) {
+                            std::unique_lock lock(mutex_);
+                            write_cv_.notify_one();
+                        }
+                        pos = head_.load(std::memory_order_relaxed);
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = head_.load(std::memory_order_relaxed);
+                }
+            }
+            auto ptr = std::launder(reinterpret_cast<T*>(c->data));
+            t = std::move(*ptr);
+            ptr->~T();
+            c->seq.store(pos + mask_ + 1, std::memory_order_release);
+            return true;
+        }
+
+        template <typename T>
+        template <typename U>
+        bool BoundedQueueChannel<T>::push(U&& u) {
+            auto pos = tail_.load(std::memory_order_relaxed);
+            cell* c;
+            for (;;) {
+                c = &cells_[pos & mask_];
+                auto seq = c->seq.load(std::memory_order_acquire);
+                auto diff = ptrdiff_t(seq) - ptrdiff_t(pos);
+                if (diff == 0) {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = tail_.load(std::memory_order_relaxed);
+                }
+            }
+            // The slot is already claimed, so a throwing constructor must
+            // still publish it, marked for readers to step over
+            try {
+                new (c->data) T(std::forward<U>(u));
+            }
+            catch (...) {
+                c->skipped = true;
+                c->seq.store(pos + 1, std::memory_order_release);
+                throw;
+            }
+            c->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        template <typename T>
+        template <typename U>
+        bool BoundedQueueChannel<T>::do_write(U&& u, Channel::duration timeout) {
+            if (! open_)
+                return false;
+            if (! push(std::forward<U>(u))) {
+                if (timeout <= Channel::duration())
+                    return false;
+                auto deadline = Channel::clock::now() + std::min(timeout, Channel::duration(std::chrono::hours(24 * 365)));
+                ++writers_waiting_;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                for (;;) {
+                    {
+                        std::unique_lock lock(mutex_);
+                        bool ok = write_cv_.wait_until(lock, deadline, [&] { return ! open_ || has_space(); });
+                        if (! open_ || ! ok) {
+                            --writers_waiting_;
+                            return false;
+                        }
+                    }
+                    if (push(std::forward<U>(u)))
+                        break;
+                }
+                --writers_waiting_;
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (readers_waiting_ > 0) {
+                std::unique_lock lock(mutex_);
+                read_cv_.notify_one();
+            }
+            this->notify();
+            return true;
+        }
+
+    template <typename T>
+    class SpscQueueChannel:
+    public MessageChannel<T> {
+    public:
+        explicit SpscQueueChannel(size_t capacity);
+        ~SpscQueueChannel() noexcept override { clear(); }
+        SpscQueueChannel(const SpscQueueChannel&) = delete;
+        SpscQueueChannel(SpscQueueChannel&&) = delete;
+        SpscQueueChannel& operator=(const SpscQueueChannel&) = delete;
+        SpscQueueChannel& operator=(SpscQueueChannel&&) = delete;
+        void close() noexcept override;
+        bool is_closed() const noexcept override { return ! open_; }
+        bool read(T& t) override;
+        size_t capacity() const noexcept { return mask_ + 1; }
+        void clear() noexcept;
+        bool empty() const noexcept { return size() == 0; }
+        size_t size() const noexcept;
+        bool try_write(const T& t) { return do_write(t, false); }
+        bool try_write(T&& t) { return do_write(std::move(t), false); }
+        bool write(const T& t) { return do_write(t, true); }
+        bool write(T&& t) { return do_write(std::move(t), true); }
+    protected:
+        bool do_wait_for(Channel::duration t) override;
+        bool is_notifying() const noexcept override { return true; }
+    private:
+        struct slot {
+            alignas(T) unsigned char data[sizeof(T)];
+        };
+        static constexpr int spin_count = 256;
+        std::unique_ptr<slot[]> slots_;
+        size_t mask_;
+        alignas(64) std::atomic<size_t> head_ {0}; // Consumer side
+        size_t tail_cache_ = 0;
+        std::atomic<bool> reader_waiting_ {false};
+        Detail::Futex read_futex_;
+        alignas(64) std::atomic<size_t> tail_ {0}; // Producer side
+        size_t head_cache_ = 0;
+        std::atomic<bool> writer_waiting_ {false};
+        Detail::Futex write_futex_;
+        alignas(64) std::atomic<bool> open_ {true};
+        bool has_data() noexcept;
+        template <typename U> bool do_write(U&& u, bool block);
+    };
+
+        template <typename T>
+        SpscQueueChannel<T>::SpscQueueChannel(size_t capacity) {
+            size_t n = 2;
+            while (n < capacity)
+                n *= 2;
+            slots_ = std::make_unique<slot[]>(n);
+            mask_ = n - 1;
+        }
+
+        template <typename T>
+        void SpscQueueChannel<T>::close() noexcept {
+            if (! open_.exchange(false))
+                return;
+            read_futex_.wake();
+            write_futex_.wake();
+            this->notify();
+        }
+
+        template <typename T>
+        bool SpscQueueChannel<T>::read(T& t) {
+            if (! open_ || ! has_data())
+                return false;
+            auto pos = head_.load(std::memory_order_relaxed);
+            auto ptr = std::launder(reinterpret_cast<T*>(slots_[pos & mask_].data));
+            t = std::move(*ptr);
+            ptr->~T();
+            head_.store(pos + 1, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (writer_waiting_.load(std::memory_order_relaxed))
+                write_futex_.wake();
+            return true;
+        }
+
+        template <typename T>
+        void SpscQueueChannel<T>::clear() noexcept {
+            auto pos = head_.load(std::memory_order_relaxed);
+            auto end = tail_.load(std::memory_order_acquire);
+            for (; pos != end; ++pos)
+                std::launder(reinterpret_cast<T*>(slots_[pos & mask_].data))->~T();
+            tail_cache_ = end;
+            head_.store(pos, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (writer_waiting_.load(std::memory_order_relaxed))
+                write_futex_.wake();
+        }
+
+        template <typename T>
+        size_t SpscQueueChannel<T>::size() const noexcept {
+            auto head = head_.load(std::memory_order_acquire);
+            auto tail = tail_.load(std::memory_order_acquire);
+            return head < tail ? tail - head : 0;
+        }
+
+        template <typename T>
+        bool SpscQueueChannel<T>::do_wait_for(Channel::duration t) {
+            if (! open_ || has_data())
+                return true;
+            if (t <= Channel::duration())
+                return false;
+            for (int i = 0; i < spin_count; ++i) {
+                std::this_thread::yield();
+                if (! open_ || has_data())
+                    return true;
+            }
+            auto deadline = Channel::clock::now() + t;
+            for (;;) {
+                auto word = read_futex_.load();
+                reader_waiting_.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (! open_ || has_data())
+                    break;
+                auto now = Channel::clock::now();
+                if (now >= deadline)
+                    break;
+                read_futex_.wait(word, deadline - now);
+            }
+            reader_waiting_.store(false, std::memory_order_relaxed);
+            return ! open_ || has_data();
+        }
+
+        template <typename T>
+        bool SpscQueueChannel<T>::has_data() noexcept {
+            auto pos = head_.load(std::memory_order_relaxed);
+            if (pos != tail_cache_)
+                return true;
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            return pos != tail_cache_;
+        }
+
+        template <typename T>
+        template <typename U>
+        bool SpscQueueChannel<T>::do_write(U&& u, bool block) {
+            if (! open_)
+                return false;
+            auto pos = tail_.load(std::memory_order_relaxed);
+            if (pos - head_cache_ > mask_) {
+                head_cache_ = head_.load(std::memory_order_acquire);
+                if (pos - head_cache_ > mask_) {
+                    if (! block)
+                        return false;
+                    for (int i = 0; pos - head_cache_ > mask_; ++i) {
+                        if (! open_)
+                            return false;
+                        if (i < spin_count) {
+                            std::this_thread::yield();
+                        } else {
+                            auto word = write_futex_.load();
+                            writer_waiting_.store(true, std::memory_order_relaxed);
+                            std::atomic_thread_fence(std::memory_order_seq_cst);
+                            if (pos - head_.load(std::memory_order_acquire) > mask_ && open_)
+                                write_futex_.wait(word, std::chrono::seconds(1));
+                            writer_waiting_.store(false, std::memory_order_relaxed);
+                        }
+                        head_cache_ = head_.load(std::memory_order_acquire);
+                    }
+                }
+            }
+            new (slots_[pos & mask_].data) T(std::forward<U>(u));
+            tail_.store(pos + 1, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (reader_waiting_.load(std::memory_order_relaxed))
+                read_futex_.wake();
+            this->notify();
+            return true;
+        }
+
+    template <typename T>
+    class BroadcastChannel {
+    private:
+        struct state;
+    public:
+        enum class policy { drop, block, disconnect };
+        class subscriber;
+        explicit BroadcastChannel(size_t capacity, policy p = policy::drop);
+        ~BroadcastChannel() noexcept { close(); }
+        BroadcastChannel(const BroadcastChannel&) = delete;
+        BroadcastChannel(BroadcastChannel&&) = delete;
+        BroadcastChannel& operator=(const BroadcastChannel&) = delete;
+        BroadcastChannel& operator=(BroadcastChannel&&) = delete;
+        size_t capacity() const noexcept { return state_->mask + 1; }
+        void close() noexcept;
+        bool is_closed() const noexcept;
+        policy get_policy() const noexcept { return state_->pol; }
+        std::unique_ptr<subscriber> subscribe();
+        size_t subscribers() const noexcept;
+        bool try_write(const T& t) { return do_write(t, false); }
+        bool try_write(T&& t) { return do_write(std::move(t), false); }
+        bool write(const T& t) { return do_write(t, true); }
+        bool write(T&& t) { return do_write(std::move(t), true); }
+    private:
+        struct state {
+            std::mutex mutex;
+            std::condition_variable read_cv;
+            std::condition_variable write_cv;
+            std::vector<T> ring;
+            size_t mask = 0;
+            uint64_t seq = 0;
+            std::vector<subscriber*> subs;
+            policy pol = policy::drop;
+            bool open = true;
+        };
+        std::shared_ptr<state> state_;
+        bool has_room() const noexcept;
+        template <typename U> bool do_write(U&& u, bool block);
+    };
+
+    template <typename T>
+    class BroadcastChannel<T>::subscriber:
+    public MessageChannel<T> {
+    public:
+        ~subscriber() noexcept override;
+        subscriber(const subscriber&) = delete;
+        subscriber(subscriber&&) = delete;
+        subscriber& operator=(const subscriber&) = delete;
+        subscriber& operator=(subscriber&&) = delete;
+        void close() noexcept override;
+        bool is_closed() const noexcept override { return ! open_; }
+        bool read(T& t) override;
+        size_t dropped() const noexcept;
+        bool is_disconnected() const noexcept;
+        size_t pending() const noexcept;
+    protected:
+        bool do_wait_for(Channel::duration t) override;
+        bool is_notifying() const noexcept override { return true; }
+    private:
+        friend class BroadcastChannel;
+        std::shared_ptr<state> state_;
+        uint64_t cursor_;
+        size_t dropped_ = 0;
+        std::atomic<bool> open_ {true};
+        bool disconnected_ = false;
+        explicit subscriber(std::shared_ptr<state> s) noexcept: state_(std::move(s)), cursor_(state_->seq) {}
+        void catch_up() noexcept;
+    };
+
+        template <typename T>
+        BroadcastChannel<T>::BroadcastChannel(size_t capacity, policy p):
+        state_(std::make_shared<state>()) {
+            size_t n = 2;
+            while (n < capacity)
+                n *= 2;
+            state_->ring.resize(n);
+            state_->mask = n - 1;
+            state_->pol = p;
+        }
+
+        template <typename T>
+        void BroadcastChannel<T>::close() noexcept {
+            std::unique_lock lock(state_->mutex);
+            if (! state_->open)
+                return;
+            state_->open = false;
+            for (auto sub: state_->subs) {
+                sub->open_ = false;
+                sub->notify();
+            }
+            state_->read_cv.notify_all();
+            state_->write_cv.notify_all();
+        }
+
+        template <typename T>
+        bool BroadcastChannel<T>::is_closed() const noexcept {
+            std::unique_lock lock(state_->mutex);
+            return ! state_->open;
+        }
+
+        template <typename T>
+        std::unique_ptr<typename BroadcastChannel<T>::subscriber> BroadcastChannel<T>::subscribe() {
+            std::unique_lock lock(state_->mutex);
+            std::unique_ptr<subscriber> sub(new subscriber(state_));
+            if (state_->open)
+                state_->subs.push_back(sub.get());
+            else
+                sub->open_ = false;
+            return sub;
+        }
+
+        template <typename T>
+        size_t BroadcastChannel<T>::subscribers() const noexcept {
+            std::unique_lock lock(state_->mutex);
+            return std::count_if(state_->subs.begin(), state_->subs.end(),
+                [] (auto sub) { return bool(sub->open_); });
+        }
+
+        template <typename T>
+        bool BroadcastChannel<T>::has_room() const noexcept {
+            for (auto sub: state_->subs)
+                if (sub->open_ && state_->seq - sub->cursor_ > state_->mask)
+                    return false;
+            return true;
+        }
+
+        template <typename T>
+        template <typename U>
+        bool BroadcastChannel<T>::do_write(U&& u, bool block) {
+            std::unique_lock lock(state_->mutex);
+            if (! state_->open)
+                return false;
+            if (state_->pol == policy::block) {
+                if (! has_room()) {
+                    if (! block)
+                        return false;
+                    state_->write_cv.wait(lock, [&] { return ! state_->open || has_room(); });
+                    if (! state_->open)
+                        return false;
+                }
+            } else if (state_->pol == policy::disconnect) {
+                for (auto sub: state_->subs) {
+                    if (sub->open_ && state_->seq - sub->cursor_ > state_->mask) {
+                        sub->open_ = false;
+                        sub->disconnected_ = true;
+                    }
+                }
+            }
+            state_->ring[state_->seq & state_->mask] = std::forward<U>(u);
+            ++state_->seq;
+            for (auto sub: state_->subs)
+                sub->notify();
+            state_->read_cv.notify_all();
+            return true;
+        }
+
+        template <typename T>
+        BroadcastChannel<T>::subscriber::~subscriber() noexcept {
+            std::unique_lock lock(state_->mutex);
+            auto& subs = state_->subs;
+            subs.erase(std::remove(subs.begin(), subs.end(), this), subs.end());
+            state_->write_cv.notify_all();
+        }
+
+        template <typename T>
+        void BroadcastChannel<T>::subscriber::close() noexcept {
+            std::unique_lock lock(state_->mutex);
+            open_ = false;
+            state_->read_cv.notify_all();
+            state_->write_cv.notify_all();
+            this->notify();
+        }
+
+        template <typename T>
+        bool BroadcastChannel<T>::subscriber::read(T& t) {
+            std::unique_lock lock(state_->mutex);
+            if (! open_)
+                return false;
+            catch_up();
+            if (cursor_ == state_->seq)
+                return false;
+            t = state_->ring[cursor_ & state_->mask];
+            ++cursor_;
+            if (state_->pol == policy::block)
+                state_->write_cv.notify_all();
+            return true;
+        }
+
+        template <typename T>
+        size_t BroadcastChannel<T>::subscriber::dropped() const noexcept {
+            std::unique_lock lock(state_->mutex);
+            size_t cap = state_->mask + 1;
+            size_t behind = state_->seq - cursor_;
+            return dropped_ + (behind > cap ? behind - cap : 0);
+        }
+
+        template <typename T>
+        bool BroadcastChannel<T>::subscriber::is_disconnected() const noexcept {
+            std::unique_lock lock(state_->mutex);
+            return disconnected_;
+        }
+
+        template <typename T>
+        size_t BroadcastChannel<T>::subscriber::pending() const noexcept {
+            std::unique_lock lock(state_->mutex);
+            if (! open_)
+                return 0;
+            return std::min(state_->seq - cursor_, uint64_t(state_->mask + 1));
+        }
+
+        template <typename T>
+        bool BroadcastChannel<T>::subscriber::do_wait_for(Channel::duration t) {
+            std::unique_lock lock(state_->mutex);
+            auto ready = [&] { return ! open_ || cursor_ != state_->seq; };
+            if (! ready() && t > Channel::duration())
+                state_->read_cv.wait_for(lock, t, ready);
+            return ready();
+        }
+
+        template <typename T>
+        void BroadcastChannel<T>::subscriber::catch_up() noexcept {
+            // Messages older than one ring's length have been overwritten
+            size_t cap = state_->mask + 1;
+            if (state_->seq - cursor_ > cap) {
+                dropped_ += state_->seq - cap - cursor_;
+                cursor_ = state_->seq - cap;
+            }
+        }
+
     template <typename T>
     class ValueChannel:
     public MessageChannel<T> {
@@ -264,6 +1103,7 @@ namespace RS::IO {
         bool write(T&& t);
     protected:
         bool do_wait_for(Channel::duration t) override;
+        bool is_notifying() const noexcept override { return true; }
     private:
         std::mutex mutex_;
         std::condition_variable cv_;
@@ -276,6 +1116,7 @@ namespace RS::IO {
             std::unique_lock lock(mutex_);
             status = -1;
             cv_.notify_all();
+            this->notify();
         }
 
         template <typename T>
@@ -298,6 +1139,7 @@ namespace RS::IO {
             value_ = t;
             status = 1;
             cv_.notify_all();
+            this->notify();
             return true;
         }
 
@@ -311,6 +1153,7 @@ namespace RS::IO {
             value_ = std::move(t);
             status = 1;
             cv_.notify_all();
+            this->notify();
             return true;
         }
 
@@ -333,17 +1176,28 @@ namespace RS::IO {
         void close() noexcept override;
         bool is_closed() const noexcept override { return ! open_; }
         size_t read(void* dst, size_t maxlen) override;
+        bool adopt(std::string&& src);
         void clear() noexcept;
-        bool write(std::string_view src) { return write(src.data(), src.size()); }
-        bool write(const void* src, size_t len);
+        size_t consume(size_t n) noexcept;
+        bool empty() const noexcept { return size() == 0; }
+        std::vector<std::string_view> peek(size_t maxlen = npos) const;
+        size_t size() const noexcept;
+        bool write(std::string_view src) { return writev(&src, 1); }
+        bool write(const void* src, size_t len) { return write(std::string_view(static_cast<const char*>(src), len)); }
+        bool writev(const std::string_view* src, size_t n);
+        bool writev(std::initializer_list<std::string_view> src) { return writev(src.begin(), src.size()); }
     protected:
         bool do_wait_for(duration t) override;
+        bool is_notifying() const noexcept override { return true; }
     private:
-        std::mutex mutex_;
+        static constexpr size_t chunk_size = 16384;
+        mutable std::mutex mutex_;
         std::condition_variable cv_;
-        std::string buf_;
-        size_t ofs_ = 0;
+        std::deque<std::string> chunks_; // Chunks never reallocate once readable
+        size_t ofs_ = 0; // Read position in front chunk
+        size_t size_ = 0;
         bool open_ = true;
+        void drop_front(size_t n) noexcept;
     };
 
     // Dispatch controller class
@@ -360,7 +1214,10 @@ namespace RS::IO {
             bool is_error() const noexcept { return bool(error); }
         };
 
-        Dispatch() = default;
+        enum class mode { threads, reactor };
+        enum class order { serial, concurrent };
+
+        explicit Dispatch(mode m = mode::threads);
         ~Dispatch() noexcept;
         Dispatch(const Dispatch&) = delete;
         Dispatch(Dispatch&&) = delete;
@@ -368,28 +1225,97 @@ namespace RS::IO {
         Dispatch& operator=(Dispatch&&) = delete;
 
         template <typename T, typename F> void add(MessageChannel<T>& c, F f);
+        template <typename T, typename F> void add(QueueChannel<T>& c, F f);
         template <typename F> void add(MessageChannel<void>& c, F f);
         template <typename F> void add(StreamChannel& c, F f);
+        template <typename T, typename F> void add(MessageChannel<T>& c, ThreadPool& pool, F f, order o = order::serial)
+            { add_pooled(c, make_executor(pool, o), std::move(f)); }
+        template <typename T, typename F> void add(QueueChannel<T>& c, ThreadPool& pool, F f, order o = order::serial)
+            { add_pooled(c, make_executor(pool, o), std::move(f)); }
+        template <typename F> void add(MessageChannel<void>& c, ThreadPool& pool, F f, order o = order::serial)
+            { add_pooled(c, make_executor(pool, o), std::move(f)); }
+        template <typename F> void add(StreamChannel& c, ThreadPool& pool, F f)
+            { add_pooled(c, make_executor(pool, order::serial), std::move(f)); }
+        template <typename T, typename F> void add(MessageChannel<T>& c, Strand& strand, F f)
+            { add_pooled(c, make_executor(strand), std::move(f)); }
+        template <typename T, typename F> void add(QueueChannel<T>& c, Strand& strand, F f)
+            { add_pooled(c, make_executor(strand), std::move(f)); }
+        template <typename F> void add(MessageChannel<void>& c, Strand& strand, F f)
+            { add_pooled(c, make_executor(strand), std::move(f)); }
+        template <typename F> void add(StreamChannel& c, Strand& strand, F f)
+            { add_pooled(c, make_executor(strand), std::move(f)); }
         bool empty() noexcept { return tasks_.empty(); }
+        mode get_mode() const noexcept { return mode_; }
         result run() noexcept;
         void stop() noexcept;
+        TimerWheel& timers() noexcept { return wheel_; }
 
     private:
 
         friend class Channel;
 
+        enum class kind { polled, thread, handle, notify };
+
+        // Handlers for pool channels are posted to the pool, or to a strand
+        // for serial order, by the reading side; active counts jobs not yet
+        // finished, so a channel is not dropped while its handlers are still
+        // running
+
+        struct executor_info {
+            ThreadPool* pool = nullptr;
+            Strand* strand = nullptr;
+            std::mutex mutex;
+            std::condition_variable idle;
+            std::atomic<int> active {0};
+            std::atomic<bool> faulted {false};
+            std::unique_ptr<Strand> own_strand; // Last, so it is drained first
+        };
+
+        using executor_ptr = std::shared_ptr<executor_info>;
+
+        struct pool_job;
+
         struct task_info {
             TL::Thread thread;
             std::function<void()> handler;
+            executor_ptr executor;
+            kind type = kind::polled;
+            Channel::native_handle handle = Channel::no_handle;
+            bool done = false;
         };
 
         std::map<Channel*, std::unique_ptr<task_info>> tasks_;
         std::deque<result> faults_;
         std::mutex faults_mutex_;
+        mode mode_;
+        int epoll_ = -1;
+        int event_ = -1;
+        size_t polled_ = 0;
+        std::vector<Channel*> timed_;
+        std::deque<Channel*> ready_;
+        std::vector<Channel*> signalled_;
+        std::mutex signal_mutex_;
+        std::condition_variable signal_cv_;
+        bool woken_ = false;
+        TimerWheel wheel_;
 
-        void add_channel(Channel& c, std::function<void()> f);
-        void drop_channel(Channel& c) noexcept;
+        void add_channel(Channel& c, std::function<void()> f, executor_ptr ex = {});
+        void drop_channel(Channel& c, bool live = true) noexcept;
         void set_fault(Channel& c, std::exception_ptr e = {});
+        void collect(Channel::duration timeout);
+        int run_pending();
+        bool service(Channel& c, task_info& task);
+        void signal(Channel& c) noexcept;
+        void wake() noexcept;
+        bool on_wheel(Channel& c) const noexcept;
+        static executor_ptr make_executor(ThreadPool& pool, order o);
+        static executor_ptr make_executor(Strand& strand);
+        void post(const executor_ptr& ex, Channel& c, Detail::PoolTask job);
+
+        template <typename T, typename F> void add_pooled(MessageChannel<T>& c, executor_ptr ex, F f);
+        template <typename T, typename F> void add_pooled(QueueChannel<T>& c, executor_ptr ex, F f);
+        template <typename F> void add_pooled(MessageChannel<void>& c, executor_ptr ex, F f);
+        template <typename F> void add_pooled(StreamChannel& c, executor_ptr ex, F f);
 
         template <typename Arg, typename F> static void check_call(F& f);
 
@@ -401,6 +1327,20 @@ namespace RS::IO {
             add_channel(c, [&c,f,t=T()] () mutable { if (c.read(t)) f(t); });
         }
 
+        template <typename T, typename F>
+        void Dispatch::add(QueueChannel<T>& c, F f) {
+            if constexpr (std::is_invocable_v<F&, std::vector<T>&> && ! std::is_invocable_v<F&, const T&>) {
+                check_call<std::vector<T>&>(f);
+                add_channel(c, [&c,f,v=std::vector<T>()] () mutable {
+                    v.clear();
+                    if (c.read_batch(std::back_inserter(v)))
+                        f(v);
+                });
+            } else {
+                add(static_cast<MessageChannel<T>&>(c), std::move(f));
+            }
+        }
+
         template <typename F>
         void Dispatch::add(MessageChannel<void>& c, F f) {
             check_call<void>(f);
@@ -413,6 +1353,53 @@ namespace RS::IO {
             add_channel(c, [&c,f,s=std::string()] () mutable { if (c.append(s)) f(s); });
         }
 
+        template <typename T, typename F>
+        void Dispatch::add_pooled(MessageChannel<T>& c, executor_ptr ex, F f) {
+            check_call<const T&>(f);
+            auto fp = std::make_shared<F>(std::move(f));
+            add_channel(c, [this,&c,ex,fp,t=T()] () mutable {
+                if (c.read(t))
+                    post(ex, c, [fp,m=std::move(t)] { (*fp)(m); });
+            }, ex);
+        }
+
+        template <typename T, typename F>
+        void Dispatch::add_pooled(QueueChannel<T>& c, executor_ptr ex, F f) {
+            if constexpr (std::is_invocable_v<F&, std::vector<T>&> && ! std::is_invocable_v<F&, const T&>) {
+                check_call<std::vector<T>&>(f);
+                auto fp = std::make_shared<F>(std::move(f));
+                add_channel(c, [this,&c,ex,fp] {
+                    std::vector<T> v;
+                    if (c.read_batch(std::back_inserter(v)))
+                        post(ex, c, [fp,v=std::move(v)] () mutable { (*fp)(v); });
+                }, ex);
+            } else {
+                add_pooled(static_cast<MessageChannel<T>&>(c), std::move(ex), std::move(f));
+            }
+        }
+
+        template <typename F>
+        void Dispatch::add_pooled(MessageChannel<void>& c, executor_ptr ex, F f) {
+            check_call<void>(f);
+            auto fp = std::make_shared<F>(std::move(f));
+            add_channel(c, [this,&c,ex,fp] { post(ex, c, [fp] { (*fp)(); }); }, ex);
+        }
+
+        template <typename F>
+        void Dispatch::add_pooled(StreamChannel& c, executor_ptr ex, F f) {
+            check_call<std::string&>(f);
+            auto fp = std::make_shared<F>(std::move(f));
+            auto buf = std::make_shared<std::string>();
+            add_channel(c, [this,&c,ex,fp,buf] {
+                std::string s;
+                if (c.append(s))
+                    post(ex, c, [fp,buf,s=std::move(s)] {
+                        *buf += s;
+                        (*fp)(*buf);
+                    });
+            }, ex);
+        }
+
         template <typename Arg, typename F>
         void Dispatch::check_call(F& f) {
             if constexpr (std::is_void_v<Arg>)
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "rs-io/channel.hpp"
+#include "rs-io/thread-pool.hpp"
+
+#ifdef RS_IO_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace RS::IO {
+
+    template <typename T = void> class Task;
+
+    namespace Detail {
+
+        struct TaskPromiseBase {
+            struct final_awaiter {
+                bool await_ready() const noexcept { return false; }
+                template <typename P> std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) const noexcept {
+                    auto next = h.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            final_awaiter final_suspend() const noexcept { return {}; }
+            void unhandled_exception() noexcept { error = std::current_exception(); }
+        };
+
+        template <typename T>
+        struct TaskPromise:
+        TaskPromiseBase {
+            std::optional<T> value;
+            Task<T> get_return_object() noexcept;
+            template <typename U> void return_value(U&& u) { value.emplace(std::forward<U>(u)); }
+            T result() {
+                if (error)
+                    std::rethrow_exception(error);
+                return std::move(*value);
+            }
+        };
+
+        template <>
+        struct TaskPromise<void>:
+        TaskPromiseBase {
+            Task<void> get_return_object() noexcept;
+            void return_void() noexcept {}
+            void result() {
+                if (error)
+                    std::rethrow_exception(error);
+            }
+        };
+
+        class ScheduleOn {
+        public:
+            explicit ScheduleOn(ThreadPool& pool) noexcept: pool_(&pool) {}
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { pool_->insert([h] { h.resume(); }); }
+            void await_resume() const noexcept {}
+        private:
+            ThreadPool* pool_;
+        };
+
+        // The first hop of a spawned task. The resume job owns the frame
+        // until it runs; if the pool discards it instead, the frame is
+        // destroyed and the spawn future is broken.
+
+        template <typename T>
+        class SpawnOn {
+        public:
+            SpawnOn(ThreadPool& pool, std::shared_ptr<FutureState<T>> state) noexcept:
+                pool_(&pool), state_(std::move(state)) {}
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) noexcept;
+            void await_resume() const noexcept {}
+        private:
+            class resume_job {
+            public:
+                resume_job(std::coroutine_handle<> h, std::shared_ptr<FutureState<T>> state) noexcept:
+                    handle_(h), state_(std::move(state)) {}
+                ~resume_job() noexcept;
+                resume_job(const resume_job&) = delete;
+                resume_job(resume_job&& j) noexcept: handle_(std::exchange(j.handle_, {})), state_(std::move(j.state_)) {}
+                resume_job& operator=(const resume_job&) = delete;
+                resume_job& operator=(resume_job&&) = delete;
+                void operator()() { std::exchange(handle_, {}).resume(); }
+            private:
+                std::coroutine_handle<> handle_;
+                std::shared_ptr<FutureState<T>> state_;
+            };
+            ThreadPool* pool_;
+            std::shared_ptr<FutureState<T>> state_;
+        };
+
+            template <typename T>
+            void SpawnOn<T>::await_suspend(std::coroutine_handle<> h) noexcept {
+                // The frame (and this awaiter) may be gone as soon as the job
+                // leaves our hands, including when insert() throws
+                try {
+                    pool_->insert(resume_job(h, state_));
+                }
+                catch (...) {}
+            }
+
+            template <typename T>
+            SpawnOn<T>::resume_job::~resume_job() noexcept {
+                if (handle_) {
+                    handle_.destroy();
+                    state_->set_error(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+                }
+            }
+
+        struct DetachedTask {
+            struct promise_type {
+                DetachedTask get_return_object() noexcept { return {}; }
+                std::suspend_never initial_suspend() const noexcept { return {}; }
+                std::suspend_never final_suspend() const noexcept { return {}; }
+                void return_void() noexcept {}
+                void unhandled_exception() noexcept { std::terminate(); }
+            };
+        };
+
+        struct FutureAccess {
+            template <typename T>
+            static Future<T> make(ThreadPool& pool, std::shared_ptr<FutureState<T>> state) noexcept {
+                return Future<T>(pool, std::move(state));
+            }
+        };
+
+    }
+
+    // Coroutine task
+
+    template <typename T>
+    class Task {
+
+    public:
+
+        using promise_type = Detail::TaskPromise<T>;
+        using value_type = T;
+
+        Task() = default;
+        ~Task() noexcept { if (handle_) handle_.destroy(); }
+        Task(const Task&) = delete;
+        Task(Task&& t) noexcept: handle_(std::exchange(t.handle_, {})) {}
+        Task& operator=(const Task&) = delete;
+        Task& operator=(Task&& t) noexcept;
+
+        bool valid() const noexcept { return bool(handle_); }
+
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept;
+        T await_resume() { return handle_.promise().result(); }
+
+    private:
+
+        friend promise_type;
+
+        std::coroutine_handle<promise_type> handle_;
+
+        explicit Task(std::coroutine_handle<promise_type> h) noexcept: handle_(h) {}
+
+    };
+
+        template <typename T>
+        Task<T>& Task<T>::operator=(Task&& t) noexcept {
+            if (&t != this) {
+                if (handle_)
+                    handle_.destroy();
+                handle_ = std::exchange(t.handle_, {});
+            }
+            return *this;
+        }
+
+        template <typename T>
+        std::coroutine_handle<> Task<T>::await_suspend(std::coroutine_handle<> caller) noexcept {
+            handle_.promise().continuation = caller;
+            return handle_;
+        }
+
+        namespace Detail {
+
+            template <typename T>
+            Task<T> TaskPromise<T>::get_return_object() noexcept {
+                return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+            }
+
+            inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+                return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+            }
+
+            template <typename T>
+            DetachedTask run_spawned(ThreadPool& pool, Task<T> task, std::shared_ptr<FutureState<T>> state) {
+                try {
+                    co_await SpawnOn<T>(pool, state);
+                    if constexpr (std::is_void_v<T>) {
+                        co_await task;
+                        auto f = [] {};
+                        state->run(f);
+                    } else {
+                        auto value = co_await task;
+                        auto f = [&value] { return std::move(value); };
+                        state->run(f);
+                    }
+                }
+                catch (...) {
+                    state->set_error(std::current_exception());
+                }
+            }
+
+        }
+
+    // Scheduling functions
+
+    inline Detail::ScheduleOn schedule_on(ThreadPool& pool) noexcept {
+        return Detail::ScheduleOn(pool);
+    }
+
+    template <typename T>
+    Future<T> spawn(ThreadPool& pool, Task<T> task) {
+        auto state = std::make_shared<Detail::FutureState<T>>();
+        Detail::run_spawned(pool, std::move(task), state);
+        return Detail::FutureAccess::make(pool, state);
+    }
+
+}
+
+#endif
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cerrno>
 #include <chrono>
+#include <climits>
 #include <cstdlib>
 #include <set>
 #include <stdexcept>
@@ -13,11 +14,15 @@
     #include <arpa/inet.h>
     #include <netdb.h>
     #include <netinet/tcp.h>
+    #include <poll.h>
     #include <sys/ioctl.h>
-    #include <sys/select.h>
     #include <unistd.h>
 #endif
 
+#ifdef __linux__
+    #include <sys/epoll.h>
+#endif
+
 using namespace std::chrono;
 using namespace std::literals;
 
@@ -31,6 +36,7 @@ namespace RS::IO {
             using SocketIop = int;
             using SocketSendRecv = ssize_t;
 
+            constexpr short poll_in = POLLIN | POLLPRI;
             constexpr int e_again = EAGAIN;
             constexpr int e_badf = EBADF;
             constexpr int eai_again = EAI_AGAIN;
@@ -41,6 +47,7 @@ namespace RS::IO {
             void clear_error() noexcept { errno = 0; }
             int close_socket(NativeSocket s) noexcept { return ::close(s); }
             int get_error() noexcept { return errno; }
+            int poll_sockets(pollfd* fds, size_t n, int ms) noexcept { return ::poll(fds, nfds_t(n), ms); }
             std::string system_string_to_utf8(const std::string& str) { return str; }
             constexpr auto ioctl_socket = &::ioctl;
 
@@ -51,6 +58,7 @@ namespace RS::IO {
             using SocketSendRecv = int;
             using sa_family_t = unsigned short;
 
+            constexpr short poll_in = POLLIN; // WSAPoll() rejects POLLPRI
             constexpr int e_again = WSAEWOULDBLOCK;
             constexpr int e_badf = WSAENOTSOCK;
             constexpr int eai_again = WSATRY_AGAIN;
@@ -62,6 +70,7 @@ namespace RS::IO {
             int close_socket(NativeSocket s) noexcept { return ::closesocket(s); }
             int get_error() noexcept { return WSAGetLastError(); }
             int ioctl_socket(NativeSocket s, long r, SocketIop* p) noexcept { return ::ioctlsocket(s, r, p); }
+            int poll_sockets(pollfd* fds, size_t n, int ms) noexcept { return ::WSAPoll(fds, ULONG(n), ms); }
 
             std::string system_string_to_utf8(const std::wstring& str) {
                 int len = WideCharToMultiByte(CP_UTF8, 0, str.data(), int(str.size()), nullptr, 0, nullptr, nullptr);
@@ -112,6 +121,67 @@ namespace RS::IO {
             return hash;
         }
 
+        // Poll timeouts are in milliseconds; round up so a short wait is not
+        // turned into a busy poll
+
+        int poll_timeout(Channel::duration t) noexcept {
+            if (t <= Channel::duration())
+                return 0;
+            if (t >= milliseconds(INT_MAX))
+                return INT_MAX;
+            return int(duration_cast<milliseconds>(t + 999us).count());
+        }
+
+        #ifdef __linux__
+
+            uint32_t epoll_mask(SocketSet::flag interest) noexcept {
+                uint32_t mask = 0;
+                if (!! (interest & SocketSet::flag::readable))
+                    mask |= EPOLLIN | EPOLLPRI | EPOLLRDHUP;
+                if (!! (interest & SocketSet::flag::writable))
+                    mask |= EPOLLOUT;
+                return mask;
+            }
+
+            SocketSet::flag epoll_flags(uint32_t events) noexcept {
+                auto flags = SocketSet::flag::none;
+                if (events & (EPOLLIN | EPOLLPRI))
+                    flags |= SocketSet::flag::readable;
+                if (events & EPOLLOUT)
+                    flags |= SocketSet::flag::writable;
+                if (events & EPOLLERR)
+                    flags |= SocketSet::flag::error;
+                if (events & (EPOLLHUP | EPOLLRDHUP))
+                    flags |= SocketSet::flag::hangup;
+                return flags;
+            }
+
+        #else
+
+            short poll_mask(SocketSet::flag interest) noexcept {
+                short mask = 0;
+                if (!! (interest & SocketSet::flag::readable))
+                    mask |= poll_in;
+                if (!! (interest & SocketSet::flag::writable))
+                    mask |= POLLOUT;
+                return mask;
+            }
+
+            SocketSet::flag poll_flags(short events) noexcept {
+                auto flags = SocketSet::flag::none;
+                if (events & (POLLIN | POLLPRI))
+                    flags |= SocketSet::flag::readable;
+                if (events & POLLOUT)
+                    flags |= SocketSet::flag::writable;
+                if (events & (POLLERR | POLLNVAL))
+                    flags |= SocketSet::flag::error;
+                if (events & POLLHUP)
+                    flags |= SocketSet::flag::hangup;
+                return flags;
+            }
+
+        #endif
+
         void control_blocking(NativeSocket sock, bool flag) {
             auto mode = SocketIop(! flag);
             clear_error();
@@ -534,27 +604,40 @@ namespace RS::IO {
         if (sock_ != no_socket) {
             close_socket(sock_);
             sock_ = no_socket;
+            notify();
         }
     }
 
     bool Socket::do_wait_for(duration t) {
-        return sock_ == no_socket || SocketSet::do_select(&sock_, 1, t);
+        return sock_ == no_socket || SocketSet::do_poll(&sock_, 1, t);
     }
 
     size_t Socket::do_read(void* dst, size_t maxlen, SocketAddress* from) {
-        if (! dst || ! maxlen || sock_ == no_socket || SocketSet::do_select(&sock_, 1) != 1)
+        if (! dst || ! maxlen || sock_ == no_socket)
             return 0;
+        // A non-blocking receive replaces the readiness check where possible,
+        // saving a system call per read
+        int flags = 0;
+        #ifdef MSG_DONTWAIT
+            flags |= MSG_DONTWAIT;
+        #else
+            if (SocketSet::do_poll(&sock_, 1) != 1)
+                return 0;
+        #endif
         auto cdst = static_cast<char*>(dst);
         NetResult<SocketSendRecv> rc;
         clear_error();
         if (from) {
             socklen_t addrlen = SocketAddress::max_size;
-            rc = net_call(::recvfrom(native(), cdst, socket_iosize(maxlen), 0, from->native(), &addrlen)).fail_if(-1, "recvfrom()");
+            rc = net_call(::recvfrom(native(), cdst, socket_iosize(maxlen), flags, from->native(), &addrlen));
             if (rc.res > 0)
                 from->set_size(addrlen);
         } else {
-            rc = net_call(::recv(native(), cdst, socket_iosize(maxlen), 0)).fail_if(-1, "recv()");
+            rc = net_call(::recv(native(), cdst, socket_iosize(maxlen), flags));
         }
+        if (rc.res == -1 && rc.err == e_again)
+            return 0;
+        rc.fail_if(-1, from ? "recvfrom()" : "recv()");
         if (rc.res == 0)
             do_close();
         return size_t(rc.res);
@@ -623,7 +706,7 @@ namespace RS::IO {
         if (sock_.native() == no_socket)
             return false;
         auto s = sock_.native();
-        if (SocketSet::do_select(&s, 1) != 1)
+        if (SocketSet::do_poll(&s, 1) != 1)
             return false;
         clear_error();
         auto rc = net_call(::accept(sock_.native(), nullptr, nullptr)).fail_if(no_socket, "socket()");
@@ -650,86 +733,215 @@ namespace RS::IO {
 
     // Class SocketSet
 
+    SocketSet::~SocketSet() noexcept {
+        #ifdef __linux__
+            if (epoll_ != -1)
+                ::close(epoll_);
+        #endif
+    }
+
     bool SocketSet::read(Channel*& t) {
         if (! open_ || channels_.empty())
             return false;
-        if (current_) {
-            t = current_;
-            current_ = nullptr;
-            return true;
+        if (! has_readable()) {
+            ready_.clear();
+            fill({});
         }
-        size_t index = std::string::npos;
-        do_select(natives_.data(), natives_.size(), {}, &index);
-        if (index == std::string::npos)
-            return false;
-        t = channels_[index];
-        return true;
+        while (! ready_.empty()) {
+            auto ev = ready_.front();
+            ready_.pop_front();
+            if (!! (ev.flags & ~ flag::writable)) {
+                t = ev.channel;
+                return true;
+            }
+        }
+        return false;
     }
 
     void SocketSet::clear() noexcept {
+        #ifdef __linux__
+            if (epoll_ != -1) {
+                ::close(epoll_);
+                epoll_ = -1;
+            }
+        #endif
         channels_.clear();
         natives_.clear();
-        current_ = nullptr;
+        interests_.clear();
+        ready_.clear();
+    }
+
+    size_t SocketSet::wait_events(std::vector<event>& events, duration t) {
+        events.clear();
+        if (ready_.empty() && open_)
+            fill(t);
+        events.assign(ready_.begin(), ready_.end());
+        ready_.clear();
+        return events.size();
     }
 
     bool SocketSet::do_wait_for(duration t) {
-        if (! open_ || current_)
+        if (! open_ || has_readable())
+            return true;
+        // Writable events are only of interest to wait_events(), and will be
+        // reported again
+        ready_.clear();
+        fill(t);
+        if (has_readable())
             return true;
-        size_t index = std::string::npos;
-        int rc = do_select(natives_.data(), natives_.size(), t, &index);
-        if (rc && index < channels_.size())
-            current_ = channels_[index];
-        return rc;
+        ready_.clear();
+        return false;
     }
 
-    void SocketSet::do_erase(Channel& c) noexcept {
-        auto it = std::find(channels_.begin(), channels_.end(), &c);
-        if (it != channels_.end()) {
-            natives_.erase(natives_.begin() + (it - channels_.begin()));
-            channels_.erase(it);
-            if (current_ == &c)
-                current_ = nullptr;
-        }
+    bool SocketSet::has_readable() const noexcept {
+        return std::any_of(ready_.begin(), ready_.end(), [] (auto& ev) { return !! (ev.flags & ~ flag::writable); });
     }
 
-    void SocketSet::do_insert(Channel& c, NativeSocket s) {
+    void SocketSet::do_erase(Channel& c, NativeSocket s) noexcept {
+        auto it = std::find(channels_.begin(), channels_.end(), &c);
+        if (it == channels_.end())
+            return;
+        auto index = it - channels_.begin();
+        #ifdef __linux__
+            // A closed socket has already left the epoll set, and its
+            // descriptor may have been reused
+            if (epoll_ != -1 && s != no_socket && s == natives_[index])
+                epoll_ctl(epoll_, EPOLL_CTL_DEL, s, nullptr);
+        #else
+            (void)s;
+        #endif
+        channels_.erase(it);
+        natives_.erase(natives_.begin() + index);
+        interests_.erase(interests_.begin() + index);
+        ready_.erase(std::remove_if(ready_.begin(), ready_.end(),
+            [&c] (auto& ev) { return ev.channel == &c; }), ready_.end());
+    }
+
+    void SocketSet::do_insert(Channel& c, NativeSocket s, flag interest) {
+        #ifdef __linux__
+            open_epoll();
+            if (s != no_socket) {
+                epoll_event event = {};
+                event.events = epoll_mask(interest);
+                event.data.ptr = &c;
+                if (epoll_ctl(epoll_, EPOLL_CTL_ADD, s, &event) == -1)
+                    throw std::system_error(errno, std::system_category(), "epoll_ctl()");
+            }
+        #endif
         channels_.push_back(&c);
         natives_.push_back(s);
+        interests_.push_back(interest);
     }
 
-    int SocketSet::do_select(NativeSocket* sockets, size_t n, duration t, size_t* index) {
+    void SocketSet::do_modify(Channel& c, NativeSocket s, flag interest) {
+        auto it = std::find(channels_.begin(), channels_.end(), &c);
+        if (it == channels_.end()) {
+            do_insert(c, s, interest);
+            return;
+        }
+        auto index = it - channels_.begin();
+        #ifdef __linux__
+            if (s != no_socket && s == natives_[index]) {
+                epoll_event event = {};
+                event.events = epoll_mask(interest);
+                event.data.ptr = &c;
+                if (epoll_ctl(epoll_, EPOLL_CTL_MOD, s, &event) == -1)
+                    throw std::system_error(errno, std::system_category(), "epoll_ctl()");
+            }
+        #endif
+        interests_[index] = interest;
+        ready_.erase(std::remove_if(ready_.begin(), ready_.end(),
+            [&c] (auto& ev) { return ev.channel == &c; }), ready_.end());
+    }
+
+    #ifdef __linux__
+
+        // The epoll set persists between waits, so each wait costs one system
+        // call regardless of the number of sockets. The kernel moves
+        // reported sockets to the back of its ready list, so sockets that
+        // stay ready are reported in turn.
+
+        size_t SocketSet::fill(duration t) {
+            static constexpr int max_events = 64;
+            open_epoll();
+            epoll_event events[max_events];
+            int n = epoll_wait(epoll_, events, max_events, poll_timeout(t));
+            if (n == -1 && errno != EINTR)
+                throw std::system_error(errno, std::system_category(), "epoll_wait()");
+            for (int i = 0; i < n; ++i)
+                ready_.push_back({static_cast<Channel*>(events[i].data.ptr), epoll_flags(events[i].events)});
+            return std::max(n, 0);
+        }
+
+        void SocketSet::open_epoll() {
+            if (epoll_ != -1)
+                return;
+            epoll_ = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_ == -1)
+                throw std::system_error(errno, std::system_category(), "epoll_create1()");
+        }
+
+    #else
+
+        // Each scan starts one place further round the set, so that sockets
+        // early in the set can't starve later ones
+
+        size_t SocketSet::fill(duration t) {
+            Detail::net_init();
+            size_t n = natives_.size();
+            size_t start = n == 0 ? 0 : next_ % n;
+            std::vector<pollfd> fds(n);
+            for (size_t i = 0; i < n; ++i) {
+                size_t j = (start + i) % n;
+                fds[i].fd = natives_[j];
+                fds[i].events = poll_mask(interests_[j]);
+                fds[i].revents = 0;
+            }
+            clear_error();
+            auto rc = net_call(poll_sockets(fds.data(), n, poll_timeout(t)));
+            rc.fail_if(-1, "poll()");
+            next_ = start + 1;
+            size_t count = 0;
+            for (size_t i = 0; i < n; ++i) {
+                if (natives_[(start + i) % n] != no_socket && fds[i].revents != 0) {
+                    ready_.push_back({channels_[(start + i) % n], poll_flags(fds[i].revents)});
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+    #endif
+
+    int SocketSet::do_poll(const NativeSocket* sockets, size_t n, duration t, size_t* index) {
         Detail::net_init();
         if (index)
             *index = std::string::npos;
-        fd_set rfds;
-        FD_ZERO(&rfds);
-        int last = -1;
+        pollfd one;
+        std::vector<pollfd> many;
+        auto fds = &one;
+        if (n > 1) {
+            many.resize(n);
+            fds = many.data();
+        }
         for (size_t i = 0; i < n; ++i) {
-            if (sockets[i] != no_socket) {
-                FD_SET(sockets[i], &rfds);
-                last = std::max(last, int(sockets[i]));
-            }
+            fds[i].fd = sockets[i];
+            fds[i].events = poll_in;
+            fds[i].revents = 0;
         }
-        fd_set efds = rfds;
-        timeval tv = {0, 0};
-        if (t > duration())
-            duration_to_timeval(t, tv);
         clear_error();
-        auto rc = net_call(::select(last + 1, &rfds, nullptr, &efds, &tv));
+        auto rc = net_call(poll_sockets(fds, n, poll_timeout(t)));
         if (rc.res == 0)
             return 0;
-        else if (rc.res == -1 && rc.err == e_badf)
-            return -1;
-        rc.fail_if(-1, "select()");
-        size_t pos = std::string::npos;
-        for (size_t i = 0; i < n && pos == std::string::npos; ++i)
-            if (sockets[i] != no_socket && (FD_ISSET(sockets[i], &rfds) || FD_ISSET(sockets[i], &efds)))
-                pos = i;
-        if (pos == std::string::npos)
-            return 0;
-        if (index)
-            *index = pos;
-        return 1;
+        rc.fail_if(-1, "poll()");
+        for (size_t i = 0; i < n; ++i) {
+            if (sockets[i] != no_socket && fds[i].revents != 0) {
+                if (index)
+                    *index = i;
+                return (fds[i].revents & POLLNVAL) ? -1 : 1;
+            }
+        }
+        return 0;
     }
 
 }
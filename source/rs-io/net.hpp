@@ -2,8 +2,10 @@
 
 #include "rs-io/channel.hpp"
 #include "rs-io/utility.hpp"
+#include "rs-tl/enum.hpp"
 #include <atomic>
 #include <cstring>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <ostream>
@@ -221,6 +223,7 @@ namespace RS::IO {
         bool write_to(const void* src, size_t len, const SocketAddress& to) { return do_write(src, len, &to); }
     protected:
         native_handle get_handle() const noexcept override { return reinterpret_cast<native_handle>(sock_); }
+        bool is_notifying() const noexcept override { return true; }
         void do_close() noexcept;
         bool do_wait_for(duration t) override;
     private:
@@ -254,12 +257,14 @@ namespace RS::IO {
         TcpServer(TcpServer&&) = delete;
         TcpServer& operator=(const TcpServer&) = delete;
         TcpServer& operator=(TcpServer&&) = delete;
-        void close() noexcept override { sock_.close(); }
+        void close() noexcept override { sock_.close(); notify(); }
         bool is_closed() const noexcept override { return sock_.is_closed(); }
         bool read(std::unique_ptr<TcpClient>& t) override;
         SocketAddress local() const { return sock_.local(); }
         NativeSocket native() const noexcept { return sock_.native(); }
     protected:
+        native_handle get_handle() const noexcept override { return reinterpret_cast<native_handle>(sock_.native()); }
+        bool is_notifying() const noexcept override { return true; }
         bool do_wait_for(duration t) override { return sock_.wait_for(t); }
     private:
         Socket sock_;
@@ -281,7 +286,19 @@ namespace RS::IO {
     class SocketSet:
     public MessageChannel<Channel*> {
     public:
+        enum class flag: int {
+            none      = 0,
+            readable  = 1 << 0,
+            writable  = 1 << 1,
+            error     = 1 << 2,
+            hangup    = 1 << 3,
+        };
+        struct event {
+            Channel* channel = nullptr;
+            flag flags = flag::none;
+        };
         SocketSet() = default;
+        ~SocketSet() noexcept override;
         SocketSet(const SocketSet&) = delete;
         SocketSet(SocketSet&&) = delete;
         SocketSet& operator=(const SocketSet&) = delete;
@@ -291,11 +308,13 @@ namespace RS::IO {
         bool read(Channel*& t) override;
         void clear() noexcept;
         bool empty() const noexcept { return channels_.empty(); }
-        void erase(Socket& s) noexcept { do_erase(s); }
-        void erase(TcpServer& s) noexcept { do_erase(s); }
-        void insert(Socket& s) { do_insert(s, s.native()); }
-        void insert(TcpServer& s) { do_insert(s, s.native()); }
+        void erase(Socket& s) noexcept { do_erase(s, s.native()); }
+        void erase(TcpServer& s) noexcept { do_erase(s, s.native()); }
+        void insert(Socket& s, flag interest = flag::readable) { do_insert(s, s.native(), interest); }
+        void insert(TcpServer& s) { do_insert(s, s.native(), flag::readable); }
+        void modify(Socket& s, flag interest) { do_modify(s, s.native(), interest); }
         size_t size() const noexcept { return channels_.size(); }
+        size_t wait_events(std::vector<event>& events, duration t = {});
     protected:
         bool do_wait_for(duration t) override;
     private:
@@ -303,14 +322,26 @@ namespace RS::IO {
         friend class TcpServer;
         std::vector<Channel*> channels_;
         std::vector<NativeSocket> natives_;
-        Channel* current_ {nullptr};
+        std::vector<flag> interests_;
+        std::deque<event> ready_; // Remainder of the last batch
         std::atomic<bool> open_ {true};
-        void do_erase(Channel& c) noexcept;
-        void do_insert(Channel& c, NativeSocket s);
-        static int do_select(NativeSocket* sockets, size_t n, duration t = {}, size_t* index = nullptr);
+        #ifdef __linux__
+            int epoll_ = -1;
+            void open_epoll();
+        #else
+            size_t next_ = 0; // Rotating start for fairness
+        #endif
+        bool has_readable() const noexcept;
+        void do_erase(Channel& c, NativeSocket s) noexcept;
+        void do_insert(Channel& c, NativeSocket s, flag interest);
+        void do_modify(Channel& c, NativeSocket s, flag interest);
+        size_t fill(duration t);
+        static int do_poll(const NativeSocket* sockets, size_t n, duration t = {}, size_t* index = nullptr);
             // +1 = ready, 0 = timeout, -1 = socket closed
     };
 
+    RS_DEFINE_BITMASK_OPERATORS(SocketSet::flag);
+
 }
 
 namespace std {
@@ -2,12 +2,14 @@
 #include <algorithm>
 #include <cerrno>
 #include <chrono>
+#include <climits>
 #include <system_error>
 
 #ifdef _XOPEN_SOURCE
-    #include <sys/select.h>
+    #include <poll.h>
     #include <sys/stat.h>
     #include <sys/wait.h>
+    #include <unistd.h>
     #define IO_FUNCTION(f) ::f
 #else
     #include <windows.h>
@@ -58,10 +60,21 @@ namespace RS::IO {
         if (! dst || ! maxlen || ! fp_)
             return 0;
         errno = 0;
-        size_t rc = fread(dst, 1, maxlen, fp_);
-        int err = errno;
-        if (rc > 0)
-            return rc;
+        #ifdef _XOPEN_SOURCE
+            // Read straight from the pipe so that a partial block doesn't
+            // stall, and the handle's readiness matches the stream state.
+            auto rc = ::read(fileno(fp_), dst, maxlen);
+            int err = errno;
+            if (rc > 0)
+                return size_t(rc);
+            if (rc == -1 && (err == EAGAIN || err == EINTR))
+                return 0;
+        #else
+            size_t rc = fread(dst, 1, maxlen, fp_);
+            int err = errno;
+            if (rc > 0)
+                return rc;
+        #endif
         if (err != 0 && err != EBADF)
             throw std::system_error(err, std::generic_category());
         do_close();
@@ -76,20 +89,18 @@ namespace RS::IO {
             t = {};
         int fd = IO_FUNCTION(fileno)(fp_);
         #ifdef _XOPEN_SOURCE
-            fd_set fds;
-            FD_ZERO(&fds);
-            FD_SET(fd, &fds);
-            timeval tv;
-            duration_to_timeval(t, tv);
+            pollfd pfd = {fd, POLLIN, 0};
+            int ms = 0;
+            if (t >= milliseconds(INT_MAX))
+                ms = INT_MAX;
+            else if (t > duration())
+                ms = int(duration_cast<milliseconds>(t + 999us).count());
             errno = 0;
-            int rc = ::select(fd + 1, &fds, nullptr, nullptr, &tv);
+            int rc = ::poll(&pfd, 1, ms);
             int err = errno;
-            if (rc == -1 && err == EBADF)
-                return true;
-            else if (rc == -1)
+            if (rc == -1)
                 throw std::system_error(err, std::generic_category());
-            else
-                return rc > 0;
+            return rc > 0; // Includes POLLNVAL if the pipe has been closed
         #else
             auto fh = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
             auto ms = duration_cast<milliseconds>(t).count();
@@ -107,6 +118,15 @@ namespace RS::IO {
         #endif
     }
 
+    Channel::native_handle StreamProcess::get_handle() const noexcept {
+        #ifdef _XOPEN_SOURCE
+            FILE* fp = fp_;
+            return fp ? fileno(fp) : no_handle;
+        #else
+            return no_handle;
+        #endif
+    }
+
     void StreamProcess::do_close() noexcept {
         if (! fp_)
             return;
@@ -114,6 +134,7 @@ namespace RS::IO {
         if (status_ == -1)
             status_ = rc;
         fp_ = nullptr;
+        notify();
     }
 
     // Class TextProcess
@@ -24,6 +24,10 @@ namespace RS::IO {
         int status() const noexcept { return status_; }
     protected:
         bool do_wait_for(duration t) override;
+        native_handle get_handle() const noexcept override;
+        #ifdef _XOPEN_SOURCE
+            bool is_notifying() const noexcept override { return true; }
+        #endif
     private:
         std::atomic<FILE*> fp_;
         int status_ = -1;
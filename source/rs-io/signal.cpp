@@ -6,6 +6,11 @@
 #include <system_error>
 #include <thread>
 
+#ifdef __linux__
+    #include <sys/signalfd.h>
+    #include <unistd.h>
+#endif
+
 using namespace std::chrono;
 
 namespace RS::IO {
@@ -36,6 +41,16 @@ namespace RS::IO {
             for (auto s: signals_)
                 sigaddset(&newmask_, s);
             pthread_sigmask(SIG_BLOCK, &newmask_, &oldmask_);
+            #ifdef __linux__
+                // Only used as a readiness handle; signals are still
+                // collected with sigtimedwait()
+                handle_ = signalfd(-1, &newmask_, SFD_CLOEXEC | SFD_NONBLOCK);
+                if (handle_ == -1) {
+                    int err = errno;
+                    pthread_sigmask(SIG_SETMASK, &oldmask_, nullptr);
+                    throw std::system_error(err, std::generic_category(), "signalfd()");
+                }
+            #endif
         }
 
         PosixSignal::~PosixSignal() noexcept {
@@ -47,12 +62,23 @@ namespace RS::IO {
                 if (sigismember(&pending, t))
                     sigwait(&pending, &s);
             pthread_sigmask(SIG_SETMASK, &oldmask_, nullptr);
+            #ifdef __linux__
+                int fd = handle_.exchange(-1);
+                if (fd != -1)
+                    ::close(fd);
+            #endif
         }
 
         void PosixSignal::close() noexcept {
             if (open_) {
                 open_ = false;
                 raise(SIGUSR1);
+                #ifdef __linux__
+                    int fd = handle_.exchange(-1);
+                    if (fd != -1)
+                        ::close(fd);
+                #endif
+                notify();
             }
         }
 
@@ -30,6 +30,10 @@ namespace RS::IO {
         static std::string name(int s);
     protected:
         bool do_wait_for(duration t) override;
+        #ifdef __linux__
+            native_handle get_handle() const noexcept override { return handle_; }
+            bool is_notifying() const noexcept override { return true; }
+        #endif
     private:
         #ifdef _XOPEN_SOURCE
             signal_list signals_;
@@ -37,6 +41,9 @@ namespace RS::IO {
             sigset_t oldmask_;
             std::deque<int> queue_;
             std::atomic<bool> open_;
+            #ifdef __linux__
+                std::atomic<int> handle_ {-1};
+            #endif
         #else
             static constexpr int max_signals = 128;
             std::vector<int> signals_;
@@ -1,51 +1,777 @@
 #include "rs-io/thread-pool.hpp"
+#include "rs-tl/guard.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <fstream>
 #include <random>
+#include <string>
+
+#ifdef __linux__
+    #include <sched.h>
+#endif
 
 using namespace std::chrono;
 
 namespace RS::IO {
 
+    namespace {
+
+        // Chase-Lev work stealing deque, following Le et al, "Correct and
+        // Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+        // Only the owning thread may call push() and pop(); any thread may
+        // call steal().
+
+        template <typename T>
+        class WorkDeque {
+
+        public:
+
+            WorkDeque(): top_(0), bottom_(0), array_(new ring(initial_size)), retired_() {}
+            ~WorkDeque() noexcept { delete array_.load(); }
+            WorkDeque(const WorkDeque&) = delete;
+            WorkDeque(WorkDeque&&) = delete;
+            WorkDeque& operator=(const WorkDeque&) = delete;
+            WorkDeque& operator=(WorkDeque&&) = delete;
+
+            bool empty() const noexcept { return bottom_.load() <= top_.load(); }
+
+            void push(T* x) {
+                auto b = bottom_.load(std::memory_order_relaxed);
+                auto t = top_.load(std::memory_order_acquire);
+                auto a = array_.load(std::memory_order_relaxed);
+                if (b - t > a->mask)
+                    a = grow(a, t, b);
+                a->put(b, x);
+                bottom_.store(b + 1, std::memory_order_release);
+            }
+
+            T* pop() noexcept {
+                auto b = bottom_.load(std::memory_order_relaxed) - 1;
+                auto a = array_.load(std::memory_order_relaxed);
+                bottom_.store(b, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                auto t = top_.load(std::memory_order_relaxed);
+                T* x = nullptr;
+                if (t <= b) {
+                    x = a->get(b);
+                    if (t == b) {
+                        if (! top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                            x = nullptr;
+                        bottom_.store(b + 1, std::memory_order_relaxed);
+                    }
+                } else {
+                    bottom_.store(b + 1, std::memory_order_relaxed);
+                }
+                return x;
+            }
+
+            T* steal() noexcept {
+                auto t = top_.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                auto b = bottom_.load(std::memory_order_acquire);
+                if (t >= b)
+                    return nullptr;
+                auto a = array_.load(std::memory_order_acquire);
+                T* x = a->get(t);
+                if (! top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    return nullptr;
+                return x;
+            }
+
+        private:
+
+            static constexpr int64_t initial_size = 64;
+
+            struct ring {
+                int64_t mask;
+                std::unique_ptr<std::atomic<T*>[]> slots;
+                explicit ring(int64_t size): mask(size - 1), slots(new std::atomic<T*>[size]) {}
+                T* get(int64_t i) const noexcept { return slots[i & mask].load(std::memory_order_relaxed); }
+                void put(int64_t i, T* x) noexcept { slots[i & mask].store(x, std::memory_order_relaxed); }
+            };
+
+            alignas(64) std::atomic<int64_t> top_;
+            alignas(64) std::atomic<int64_t> bottom_;
+            std::atomic<ring*> array_;
+            std::vector<std::unique_ptr<ring>> retired_; // Thieves may still be reading old arrays
+
+            ring* grow(ring* a, int64_t t, int64_t b) {
+                auto big = std::make_unique<ring>(2 * (a->mask + 1));
+                for (auto i = t; i < b; ++i)
+                    big->put(i, a->get(i));
+                retired_.emplace_back(a);
+                a = big.release();
+                array_.store(a, std::memory_order_release);
+                return a;
+            }
+
+        };
+
+        #ifdef __linux__
+
+            // Parse a CPU or node list such as "0-3,8-11"
+
+            std::vector<int> parse_cpu_list(const std::string& str) {
+                std::vector<int> list;
+                size_t i = 0;
+                while (i < str.size()) {
+                    size_t j = str.find_first_of(",\n", i);
+                    if (j == std::string::npos)
+                        j = str.size();
+                    auto item = str.substr(i, j - i);
+                    i = j + 1;
+                    if (item.empty())
+                        continue;
+                    size_t dash = item.find('-');
+                    try {
+                        int lo = std::stoi(item.substr(0, dash));
+                        int hi = dash == std::string::npos ? lo : std::stoi(item.substr(dash + 1));
+                        for (int k = lo; k <= hi; ++k)
+                            list.push_back(k);
+                    }
+                    catch (const std::exception&) {}
+                }
+                return list;
+            }
+
+            std::string read_line(const std::string& file) {
+                std::ifstream in(file);
+                std::string line;
+                std::getline(in, line);
+                return line;
+            }
+
+            // Returns the CPUs this process may run on, grouped by NUMA
+            // node. Nodes with no usable CPUs are omitted; if the node
+            // information is not available, all CPUs are in one group.
+
+            std::vector<std::vector<int>> cpu_topology() {
+                cpu_set_t allowed;
+                CPU_ZERO(&allowed);
+                if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+                    return {};
+                std::vector<std::vector<int>> nodes;
+                auto node_list = parse_cpu_list(read_line("/sys/devices/system/node/online"));
+                for (int node: node_list) {
+                    auto cpu_list = parse_cpu_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+                    std::vector<int> cpus;
+                    for (int cpu: cpu_list)
+                        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                            cpus.push_back(cpu);
+                    if (! cpus.empty())
+                        nodes.push_back(cpus);
+                }
+                if (nodes.empty()) {
+                    nodes.emplace_back();
+                    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                        if (CPU_ISSET(cpu, &allowed))
+                            nodes[0].push_back(cpu);
+                }
+                return nodes;
+            }
+
+            void set_affinity(const std::vector<int>& cpus) noexcept {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int cpu: cpus)
+                    CPU_SET(cpu, &set);
+                sched_setaffinity(0, sizeof(set), &set);
+            }
+
+        #endif
+
+        // Deque entries are recycled through a per-thread cache, so a job
+        // that inserts more jobs does not normally need to allocate. Entries
+        // are moved out of the deque before they are run, so an entry is
+        // returned to the cache of the thread that took it.
+
+        template <typename T>
+        class JobCache {
+        public:
+            static constexpr size_t max_size = 256;
+            ~JobCache() noexcept { for (auto job: jobs_) delete job; }
+            static std::vector<T*>& local() {
+                static thread_local JobCache cache;
+                return cache.jobs_;
+            }
+        private:
+            std::vector<T*> jobs_;
+        };
+
+    }
+
     // Class ThreadPool
 
-    ThreadPool::ThreadPool(int threads):
-    clear_count_(0), next_worker_(0), unfinished_jobs_(0), shutting_down_(false), workers_(adjust_threads(threads)) {
-        for (auto& work: workers_)
-            work.thread = std::thread(thread_payload, this, &work);
+    struct ThreadPool::job_info {
+        callback call;
+        TaskGroup* group = nullptr;
+        unsigned generation = 0;
+        steady_clock::time_point queued {}; // Only set when collecting statistics
+    };
+
+    // Statistics are written only by the owning worker (except for the
+    // shared helper counters), so relaxed increments are enough, and the
+    // counters are kept on their own cache lines.
+
+    struct alignas(64) ThreadPool::stats_counters {
+        std::atomic<uint64_t> jobs {0};
+        std::atomic<uint64_t> steals {0};
+        std::atomic<uint64_t> failed_steals {0};
+        std::atomic<uint64_t> idle_ns {0};
+        std::atomic<uint64_t> queue_latency[histogram::buckets] = {};
+        std::atomic<uint64_t> run_time[histogram::buckets] = {};
+        static void add(std::atomic<uint64_t>& n, uint64_t delta = 1) noexcept { n.fetch_add(delta, std::memory_order_relaxed); }
+        static void record(std::atomic<uint64_t>* hist, steady_clock::duration t) noexcept
+            { add(hist[histogram::bucket(uint64_t(std::max(duration_cast<nanoseconds>(t).count(), int64_t(0))))]); }
+        static void merge(histogram& h, const std::atomic<uint64_t>* hist) noexcept
+            { for (int i = 0; i < histogram::buckets; ++i) h.counts_[i] += hist[i].load(std::memory_order_relaxed); }
+    };
+
+    // The normal lane is the work stealing queues in the workers; the other
+    // lanes are shared by all workers. The deadline lane is a heap ordered by
+    // deadline, with a sequence number to keep equal deadlines in order.
+
+    struct ThreadPool::lane_queues {
+        struct deadline_job {
+            clock::time_point deadline;
+            uint64_t sequence;
+            job_info job;
+            bool operator<(const deadline_job& rhs) const noexcept
+                { return deadline == rhs.deadline ? sequence > rhs.sequence : deadline > rhs.deadline; }
+        };
+        std::mutex mutex;
+        std::vector<deadline_job> deadline;
+        std::deque<job_info> high;
+        std::deque<job_info> low;
+        uint64_t sequence = 0;
+        std::atomic<int> depth[lane_count] = {}; // Normal lane not used
+    };
+
+    struct ThreadPool::worker {
+        WorkDeque<job_info> deque;  // Jobs inserted by this worker's own jobs
+        std::mutex mutex;
+        std::deque<job_info> inbox; // Jobs inserted from outside the pool
+        ThreadPool* pool = nullptr;
+        std::vector<int> cpus;      // Affinity set, empty if not placed
+        int node = 0;
+        unsigned picks = 0;         // Jobs taken, for starvation protection
+        std::unique_ptr<stats_counters> stats;
+        std::atomic<bool> running {false};
+        std::atomic<int64_t> busy_since {0}; // Start of current job, only tracked if elastic
+        std::thread thread;
+    };
+
+    thread_local ThreadPool::worker* ThreadPool::current_worker_ = nullptr;
+
+    ThreadPool::ThreadPool(int min_threads, int max_threads, flag flags):
+    clear_count_(0), outside_pushes_(0), next_worker_(0), unfinished_jobs_(0), queued_jobs_(0), idle_threads_(0), helpers_(0), shutting_down_(false),
+    running_(0), monitor_idle_(false), block_threshold_(duration_cast<nanoseconds>(50ms).count()),
+    idle_timeout_(duration_cast<nanoseconds>(10s).count()), idle_mutex_(), idle_cv_(), done_mutex_(), done_cv_(),
+    resize_mutex_(), monitor_mutex_(), monitor_cv_(), monitor_(),
+    workers_(std::max(adjust_threads(min_threads), adjust_threads(max_threads))),
+    lanes_(std::make_unique<lane_queues>()), helper_stats_(), min_threads_(adjust_threads(min_threads)), nodes_(1), flags_(flags) {
+        bool collect = !! (flags & flag::stats);
+        if (collect)
+            helper_stats_ = std::make_unique<stats_counters>();
+        for (auto& work: workers_) {
+            work = std::make_unique<worker>();
+            work->pool = this;
+            if (collect)
+                work->stats = std::make_unique<stats_counters>();
+        }
+        if (!! flags)
+            place_workers(flags);
+        for (int i = 0; i < min_threads_; ++i)
+            start_worker(*workers_[i]);
+        if (elastic())
+            monitor_ = std::thread([this] { monitor_payload(); });
     }
 
     ThreadPool::~ThreadPool() noexcept {
         clear();
-        shutting_down_ = true;
+        // A job inserted from outside the pool can finish before the insert
+        // returns (a resumed coroutine may even destroy the pool)
+        while (outside_pushes_)
+            std::this_thread::yield();
+        {
+            std::unique_lock lock(idle_mutex_);
+            shutting_down_ = true;
+            idle_cv_.notify_all();
+        }
+        {
+            std::unique_lock lock(monitor_mutex_);
+            monitor_cv_.notify_all();
+        }
+        if (monitor_.joinable())
+            monitor_.join();
+        std::unique_lock lock(resize_mutex_);
         for (auto& work: workers_)
-            work.thread.join();
+            if (work->thread.joinable())
+                work->thread.join();
     }
 
     void ThreadPool::clear() noexcept {
         ++clear_count_;
+        int dropped = 0;
         for (auto& work: workers_) {
-            std::unique_lock lock(work.mutex);
-            unfinished_jobs_ -= int(work.queue.size());
-            work.queue.clear();
+            while (! work->deque.empty()) {
+                if (auto ptr = work->deque.steal()) {
+                    auto job = std::move(*ptr);
+                    free_job(ptr);
+                    drop_job(job);
+                    unqueue(normal_lane);
+                    ++dropped;
+                }
+            }
+            std::deque<job_info> inbox;
+            {
+                std::unique_lock lock(work->mutex);
+                inbox.swap(work->inbox);
+            }
+            for (auto& job: inbox)
+                drop_job(job);
+            unqueue(normal_lane, int(inbox.size()));
+            dropped += int(inbox.size());
+        }
+        std::vector<lane_queues::deadline_job> deadline;
+        std::deque<job_info> high, low;
+        {
+            std::unique_lock lock(lanes_->mutex);
+            deadline.swap(lanes_->deadline);
+            high.swap(lanes_->high);
+            low.swap(lanes_->low);
         }
+        for (auto& dj: deadline)
+            drop_job(dj.job);
+        for (auto& job: high)
+            drop_job(job);
+        for (auto& job: low)
+            drop_job(job);
+        unqueue(deadline_lane, int(deadline.size()));
+        unqueue(high_lane, int(high.size()));
+        unqueue(low_lane, int(low.size()));
+        dropped += int(deadline.size() + high.size() + low.size());
+        jobs_done(dropped);
         wait();
         --clear_count_;
     }
 
     void ThreadPool::wait() noexcept {
-        while (unfinished_jobs_)
-            std::this_thread::sleep_for(1ms);
+        std::unique_lock lock(done_mutex_);
+        done_cv_.wait(lock, [this] { return ! unfinished_jobs_; });
+    }
+
+    void ThreadPool::wait(bool help) noexcept {
+        if (! help) {
+            wait();
+            return;
+        }
+        job_info job;
+        int victim = 0;
+        while (unfinished_jobs_) {
+            victim = (victim + 1) % max_threads();
+            if (find_job(nullptr, job, victim)) {
+                run_job(job);
+            } else {
+                // Same handshake as the idle workers, using helpers_ and the
+                // completion condition variable.
+                std::unique_lock lock(done_mutex_);
+                ++helpers_;
+                done_cv_.wait(lock, [this] { return ! unfinished_jobs_ || queued_jobs_ > 0; });
+                --helpers_;
+            }
+        }
     }
 
     bool ThreadPool::wait_until(clock::time_point t) noexcept {
-        for (;;) {
-            if (! unfinished_jobs_)
+        std::unique_lock lock(done_mutex_);
+        return done_cv_.wait_until(lock, t, [this] { return ! unfinished_jobs_; });
+    }
+
+    void ThreadPool::drop_job(job_info& job) noexcept {
+        job.call.reset();
+        if (job.group)
+            job.group->job_done();
+    }
+
+    ThreadPool* ThreadPool::current() noexcept {
+        return current_worker_ ? current_worker_->pool : nullptr;
+    }
+
+    int ThreadPool::queue_depth(priority p) const noexcept {
+        // The normal lane isn't counted separately, to keep the hot path
+        // cheap. The counts can briefly be out of step while jobs are being
+        // inserted.
+        int lane = high_lane + int(p);
+        int n = lane == normal_lane ? queued_jobs_ - lanes_->depth[deadline_lane] - lanes_->depth[high_lane] - lanes_->depth[low_lane]
+            : lanes_->depth[lane].load();
+        return std::max(n, 0);
+    }
+
+    int ThreadPool::deadline_depth() const noexcept {
+        return std::max(lanes_->depth[deadline_lane].load(), 0);
+    }
+
+    bool ThreadPool::find_job(worker* work, job_info& job, int victim) {
+        // Lanes are normally tried in order of urgency, but every few jobs a
+        // worker tries them in reverse order, so a steady stream of urgent
+        // jobs can't starve the lower lanes.
+        static constexpr unsigned starvation_interval = 16;
+        bool reverse = work && work->picks % starvation_interval == starvation_interval - 1;
+        for (int i = 0; i < lane_count; ++i) {
+            int lane = reverse ? lane_count - 1 - i : i;
+            if (lane == normal_lane ? take_normal(work, job, victim) : take_lane(lane, job)) {
+                if (work)
+                    ++work->picks;
                 return true;
-            if (clock::now() >= t)
+            }
+        }
+        return false;
+    }
+
+    bool ThreadPool::steal_job(worker* work, job_info& job, int victim) {
+        // With more than one node, a worker tries victims on its own node
+        // before crossing to a remote one.
+        int n = max_threads();
+        int passes = work && nodes_ > 1 ? 2 : 1;
+        for (int pass = 0; pass < passes; ++pass) {
+            for (int i = 0; i < n && queued_jobs_; ++i) {
+                auto& other = *workers_[(victim + i) % n];
+                if (&other == work || (passes == 2 && (other.node == work->node) != (pass == 0)))
+                    continue;
+                bool found = false;
+                if (auto ptr = other.deque.steal()) {
+                    job = std::move(*ptr);
+                    free_job(ptr);
+                    found = true;
+                } else {
+                    std::unique_lock lock(other.mutex);
+                    if (! other.inbox.empty()) {
+                        job = std::move(other.inbox.front());
+                        other.inbox.pop_front();
+                        found = true;
+                    }
+                }
+                if (found) {
+                    unqueue(normal_lane);
+                    if (work && work->stats)
+                        stats_counters::add(work->stats->steals);
+                    return true;
+                }
+            }
+        }
+        if (work && work->stats)
+            stats_counters::add(work->stats->failed_steals);
+        return false;
+    }
+
+    bool ThreadPool::take_lane(int lane, job_info& job) {
+        auto& lanes = *lanes_;
+        if (! lanes.depth[lane])
+            return false;
+        std::unique_lock lock(lanes.mutex);
+        if (lane == deadline_lane) {
+            if (lanes.deadline.empty())
+                return false;
+            std::pop_heap(lanes.deadline.begin(), lanes.deadline.end());
+            job = std::move(lanes.deadline.back().job);
+            lanes.deadline.pop_back();
+        } else {
+            auto& queue = lane == high_lane ? lanes.high : lanes.low;
+            if (queue.empty())
                 return false;
-            std::this_thread::sleep_for(1ms);
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        unqueue(lane);
+        return true;
+    }
+
+    bool ThreadPool::take_normal(worker* work, job_info& job, int victim) {
+        if (work) {
+            if (auto ptr = work->deque.pop()) {
+                job = std::move(*ptr);
+                free_job(ptr);
+                unqueue(normal_lane);
+                return true;
+            }
+            std::unique_lock lock(work->mutex);
+            if (! work->inbox.empty()) {
+                job = std::move(work->inbox.back());
+                work->inbox.pop_back();
+                unqueue(normal_lane);
+                return true;
+            }
+        }
+        return steal_job(work, job, victim);
+    }
+
+    void ThreadPool::jobs_done(int n) noexcept {
+        if (n > 0 && (unfinished_jobs_ -= n) == 0) {
+            std::unique_lock lock(done_mutex_);
+            done_cv_.notify_all();
         }
     }
 
+    void ThreadPool::monitor_payload() noexcept {
+        // The monitor sleeps until a job is queued, then checks periodically
+        // while there are queued jobs, starting another worker if none are
+        // idle and at least one has been running the same job for longer
+        // than the block threshold. Setting monitor_idle_ before checking
+        // the queue count pairs with push_job() raising the queue count
+        // before checking monitor_idle_.
+        for (;;) {
+            {
+                std::unique_lock lock(monitor_mutex_);
+                monitor_idle_ = true;
+                if (! queued_jobs_)
+                    monitor_cv_.wait(lock, [this] { return ! monitor_idle_ || shutting_down_; });
+                monitor_idle_ = false;
+                if (shutting_down_)
+                    return;
+                auto interval = nanoseconds(block_threshold_ / 2);
+                if (monitor_cv_.wait_for(lock, interval, [this] { return bool(shutting_down_); }))
+                    return;
+            }
+            if (queued_jobs_ <= 0 || idle_threads_ > 0 || running_ >= max_threads())
+                continue;
+            auto now = steady_clock::now().time_since_epoch().count();
+            auto threshold = duration_cast<steady_clock::duration>(nanoseconds(block_threshold_)).count();
+            bool blocked = std::any_of(workers_.begin(), workers_.end(), [=] (auto& work) {
+                auto since = work->busy_since.load();
+                return work->running && since != 0 && now - since > threshold;
+            });
+            if (! blocked)
+                continue;
+            for (auto& work: workers_) {
+                if (! work->running) {
+                    try {
+                        start_worker(*work);
+                    }
+                    catch (...) {}
+                    break;
+                }
+            }
+        }
+    }
+
+    void ThreadPool::place_workers(flag flags) {
+        #ifdef __linux__
+            // Workers are dealt out to nodes in turn, and pinned workers to
+            // successive CPUs within their node.
+            auto topology = cpu_topology();
+            if (topology.empty())
+                return;
+            if (! (flags & flag::numa)) {
+                std::vector<int> all;
+                for (auto& cpus: topology)
+                    all.insert(all.end(), cpus.begin(), cpus.end());
+                topology = {all};
+            }
+            int n = int(topology.size());
+            for (int i = 0; i < max_threads(); ++i) {
+                auto& work = *workers_[i];
+                auto& cpus = topology[i % n];
+                work.node = i % n;
+                if (!! (flags & flag::pin))
+                    work.cpus = {cpus[(i / n) % cpus.size()]};
+                else
+                    work.cpus = cpus;
+            }
+            nodes_ = std::min(n, max_threads());
+        #else
+            (void)flags;
+        #endif
+    }
+
+    void ThreadPool::push_job(callback&& call, TaskGroup* group, int lane, clock::time_point deadline) {
+        auto work = current_worker_;
+        bool outside = ! work || work->pool != this;
+        if (outside)
+            ++outside_pushes_;
+        auto guard = TL::on_scope_exit([this,outside] {
+            if (outside)
+                --outside_pushes_;
+        });
+        if (clear_count_)
+            return;
+        job_info job{std::move(call), group, group ? group->generation_.load() : 0};
+        if (helper_stats_)
+            job.queued = steady_clock::now();
+        // The counts must be raised before a worker can see the job, so
+        // they are rolled back if queueing it fails
+        if (group)
+            ++group->unfinished_jobs_;
+        ++unfinished_jobs_;
+        ++queued_jobs_;
+        try {
+            if (lane != normal_lane) {
+                auto& lanes = *lanes_;
+                std::unique_lock lock(lanes.mutex);
+                if (lane == deadline_lane) {
+                    lanes.deadline.push_back({deadline, lanes.sequence++, std::move(job)});
+                    std::push_heap(lanes.deadline.begin(), lanes.deadline.end());
+                } else if (lane == high_lane) {
+                    lanes.high.push_back(std::move(job));
+                } else {
+                    lanes.low.push_back(std::move(job));
+                }
+                ++lanes.depth[lane];
+            } else if (! outside) {
+                auto ptr = alloc_job(std::move(job));
+                try {
+                    work->deque.push(ptr);
+                }
+                catch (...) {
+                    job = std::move(*ptr);
+                    free_job(ptr);
+                    throw;
+                }
+            } else {
+                // Skip slots with no running thread; a job that lands on one
+                // anyway (if its worker is retiring) will be stolen.
+                int n = max_threads();
+                int index = next_worker_;
+                for (int i = 0; i < n && ! workers_[index]->running; ++i)
+                    index = (index + 1) % n;
+                next_worker_ = (index + 1) % n;
+                work = workers_[index].get();
+                std::unique_lock lock(work->mutex);
+                work->inbox.push_back(std::move(job));
+            }
+        }
+        catch (...) {
+            job.call.reset();
+            --queued_jobs_;
+            if (group)
+                group->job_done();
+            jobs_done(1);
+            throw;
+        }
+        if (idle_threads_)
+            wake_one();
+        if (helpers_) {
+            std::unique_lock lock(done_mutex_);
+            done_cv_.notify_all();
+        }
+        if (monitor_idle_) {
+            std::unique_lock lock(monitor_mutex_);
+            monitor_idle_ = false;
+            monitor_cv_.notify_one();
+        }
+    }
+
+    void ThreadPool::run_job(job_info& job) noexcept {
+        auto work = current_worker_;
+        if (work && work->pool != this)
+            work = nullptr;
+        stats_counters* counters = nullptr;
+        steady_clock::time_point start;
+        if (helper_stats_) {
+            counters = work ? work->stats.get() : helper_stats_.get();
+            start = steady_clock::now();
+            stats_counters::record(counters->queue_latency, start - job.queued);
+        }
+        if (work && elastic())
+            work->busy_since = (counters ? start : steady_clock::now()).time_since_epoch().count();
+        if (! job.group || job.generation == job.group->generation_) {
+            try {
+                job.call();
+            }
+            catch (...) {}
+        }
+        if (work && elastic())
+            work->busy_since = 0;
+        if (counters) {
+            stats_counters::record(counters->run_time, steady_clock::now() - start);
+            stats_counters::add(counters->jobs);
+        }
+        drop_job(job);
+        jobs_done(1);
+    }
+
+    ThreadPool::statistics ThreadPool::stats() const {
+        statistics result;
+        result.workers.resize(max_threads());
+        if (! helper_stats_)
+            return result;
+        for (int i = 0; i < max_threads(); ++i) {
+            auto& counters = *workers_[i]->stats;
+            auto& ws = result.workers[i];
+            ws.jobs = counters.jobs.load(std::memory_order_relaxed);
+            ws.steals = counters.steals.load(std::memory_order_relaxed);
+            ws.failed_steals = counters.failed_steals.load(std::memory_order_relaxed);
+            ws.idle = nanoseconds(counters.idle_ns.load(std::memory_order_relaxed));
+            stats_counters::merge(result.queue_latency, counters.queue_latency);
+            stats_counters::merge(result.run_time, counters.run_time);
+        }
+        result.helper_jobs = helper_stats_->jobs.load(std::memory_order_relaxed);
+        stats_counters::merge(result.queue_latency, helper_stats_->queue_latency);
+        stats_counters::merge(result.run_time, helper_stats_->run_time);
+        return result;
+    }
+
+    void ThreadPool::start_worker(worker& work) {
+        std::unique_lock lock(resize_mutex_);
+        if (work.running || shutting_down_)
+            return;
+        if (work.thread.joinable())
+            work.thread.join();
+        work.running = true;
+        ++running_;
+        try {
+            work.thread = std::thread(thread_payload, this, &work);
+        }
+        catch (...) {
+            --running_;
+            work.running = false;
+            throw;
+        }
+    }
+
+    bool ThreadPool::try_retire() noexcept {
+        int n = running_;
+        while (n > min_threads_)
+            if (running_.compare_exchange_weak(n, n - 1))
+                return true;
+        return false;
+    }
+
+    void ThreadPool::unqueue(int lane, int n) noexcept {
+        if (lane != normal_lane)
+            lanes_->depth[lane] -= n;
+        queued_jobs_ -= n;
+    }
+
+    void ThreadPool::wake_one() noexcept {
+        std::unique_lock lock(idle_mutex_);
+        idle_cv_.notify_one();
+    }
+
+    ThreadPool::job_info* ThreadPool::alloc_job(job_info&& job) {
+        auto& cache = JobCache<job_info>::local();
+        if (cache.empty())
+            return new job_info(std::move(job));
+        auto ptr = cache.back();
+        cache.pop_back();
+        *ptr = std::move(job);
+        return ptr;
+    }
+
+    void ThreadPool::free_job(job_info* job) noexcept {
+        auto& cache = JobCache<job_info>::local();
+        if (cache.size() < JobCache<job_info>::max_size) {
+            try {
+                cache.push_back(job);
+                return;
+            }
+            catch (...) {}
+        }
+        delete job;
+    }
+
     int ThreadPool::adjust_threads(int threads) noexcept {
         if (threads <= 0)
             threads = int(std::thread::hardware_concurrency());
@@ -55,37 +781,253 @@ namespace RS::IO {
     }
 
     void ThreadPool::thread_payload(ThreadPool* pool, worker* work) noexcept {
+        static constexpr int max_spins = 64;
+        #ifdef __linux__
+            if (! work->cpus.empty())
+                set_affinity(work->cpus);
+        #endif
+        current_worker_ = work;
         auto address = uintptr_t(work);
         if constexpr (sizeof(uintptr_t) > sizeof(uint32_t))
             address ^= address >> 32;
         auto seed = uint32_t(address);
         std::minstd_rand rng(seed);
-        std::uniform_int_distribution<int> random_index(0, pool->threads() - 1);
-        callback call;
+        std::uniform_int_distribution<int> random_index(0, pool->max_threads() - 1);
+        job_info job;
+        int spins = 0;
+        bool idle = false;
+        steady_clock::time_point idle_since;
         for (;;) {
-            call = {};
-            {
-                std::unique_lock lock(work->mutex);
-                if (! work->queue.empty()) {
-                    call = std::move(work->queue.back());
-                    work->queue.pop_back();
-                }
-            }
-            if (! call) {
-                auto& worker = pool->workers_[random_index(rng)];
-                std::unique_lock lock(worker.mutex);
-                if (! worker.queue.empty()) {
-                    call = std::move(worker.queue.front());
-                    worker.queue.pop_front();
+            if (pool->find_job(work, job, random_index(rng))) {
+                if (idle) {
+                    auto t = duration_cast<nanoseconds>(steady_clock::now() - idle_since);
+                    stats_counters::add(work->stats->idle_ns, uint64_t(t.count()));
+                    idle = false;
                 }
-            }
-            if (call) {
-                call();
-                --pool->unfinished_jobs_;
+                pool->run_job(job);
+                spins = 0;
             } else if (pool->shutting_down_) {
                 break;
             } else {
-                std::this_thread::sleep_for(1ms);
+                if (work->stats && ! idle) {
+                    idle = true;
+                    idle_since = steady_clock::now();
+                }
+                if (++spins <= max_spins) {
+                    std::this_thread::yield();
+                } else {
+                    // The idle count is raised before the queue count is
+                    // checked, and insert() raises the queue count before
+                    // checking the idle count, so at least one side always
+                    // sees the other.
+                    // In an elastic pool, a worker that stays asleep for the
+                    // idle timeout retires, unless that would take the pool
+                    // below its minimum size.
+                    std::unique_lock lock(pool->idle_mutex_);
+                    auto ready = [pool] { return pool->queued_jobs_ > 0 || pool->shutting_down_; };
+                    bool retire = false;
+                    ++pool->idle_threads_;
+                    if (! pool->elastic())
+                        pool->idle_cv_.wait(lock, ready);
+                    else if (! pool->idle_cv_.wait_for(lock, nanoseconds(pool->idle_timeout_), ready))
+                        retire = pool->try_retire();
+                    --pool->idle_threads_;
+                    if (retire) {
+                        work->running = false;
+                        break;
+                    }
+                    spins = 0;
+                }
+            }
+        }
+    }
+
+    // Class ThreadPool::histogram
+
+    uint64_t ThreadPool::histogram::count() const noexcept {
+        uint64_t n = 0;
+        for (auto c: counts_)
+            n += c;
+        return n;
+    }
+
+    nanoseconds ThreadPool::histogram::max() const noexcept {
+        for (int i = buckets - 1; i >= 0; --i)
+            if (counts_[i])
+                return nanoseconds(int64_t(upper_bound(i)));
+        return {};
+    }
+
+    nanoseconds ThreadPool::histogram::mean() const noexcept {
+        uint64_t n = 0;
+        long double sum = 0;
+        for (int i = 0; i < buckets; ++i) {
+            if (counts_[i]) {
+                n += counts_[i];
+                sum += counts_[i] * ((long double)lower_bound(i) + upper_bound(i)) / 2;
+            }
+        }
+        return n ? nanoseconds(int64_t(sum / n)) : nanoseconds();
+    }
+
+    nanoseconds ThreadPool::histogram::percentile(double p) const noexcept {
+        uint64_t n = count();
+        if (n == 0)
+            return {};
+        auto target = uint64_t(std::ceil(p / 100 * n));
+        target = std::clamp(target, uint64_t(1), n);
+        uint64_t sum = 0;
+        for (int i = 0; i < buckets; ++i) {
+            sum += counts_[i];
+            if (sum >= target)
+                return nanoseconds(int64_t(upper_bound(i)));
+        }
+        return max();
+    }
+
+    int ThreadPool::histogram::bucket(uint64_t ns) noexcept {
+        if (ns < uint64_t(sub_buckets))
+            return int(ns);
+        int e = 0;
+        for (int shift = 32; shift > 0; shift /= 2)
+            if (ns >> (e + shift))
+                e += shift;
+        return (e - sub_bits + 1) * sub_buckets + int((ns >> (e - sub_bits)) & (sub_buckets - 1));
+    }
+
+    uint64_t ThreadPool::histogram::lower_bound(int bucket) noexcept {
+        if (bucket < sub_buckets)
+            return uint64_t(bucket);
+        int e = bucket / sub_buckets + sub_bits - 1;
+        return uint64_t(sub_buckets + bucket % sub_buckets) << (e - sub_bits);
+    }
+
+    uint64_t ThreadPool::histogram::upper_bound(int bucket) noexcept {
+        if (bucket < sub_buckets)
+            return uint64_t(bucket);
+        int e = bucket / sub_buckets + sub_bits - 1;
+        return lower_bound(bucket) + (uint64_t(1) << (e - sub_bits)) - 1;
+    }
+
+    // Class TaskGroup
+
+    void TaskGroup::cancel() noexcept {
+        ++generation_;
+        wait();
+    }
+
+    void TaskGroup::wait() noexcept {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return ! unfinished_jobs_; });
+    }
+
+    bool TaskGroup::wait_until(clock::time_point t) noexcept {
+        std::unique_lock lock(mutex_);
+        return cv_.wait_until(lock, t, [this] { return ! unfinished_jobs_; });
+    }
+
+    void TaskGroup::job_done() noexcept {
+        // The count only reaches zero under the mutex, so a waiter cannot
+        // see zero and destroy the group while we are still touching it.
+        auto n = unfinished_jobs_.load();
+        while (n > 1)
+            if (unfinished_jobs_.compare_exchange_weak(n, n - 1))
+                return;
+        std::unique_lock lock(mutex_);
+        if (--unfinished_jobs_ == 0)
+            cv_.notify_all();
+    }
+
+    // Class Strand
+
+    // Runs the strand's queue when scheduled on the pool; if the pool
+    // discards it unrun, the queued tasks are discarded with it
+
+    struct Strand::drain_job {
+        Strand* strand;
+        explicit drain_job(Strand* s) noexcept: strand(s) {}
+        ~drain_job() noexcept { if (strand) strand->drain(false); }
+        drain_job(const drain_job&) = delete;
+        drain_job(drain_job&& j) noexcept: strand(std::exchange(j.strand, nullptr)) {}
+        drain_job& operator=(const drain_job&) = delete;
+        drain_job& operator=(drain_job&&) = delete;
+        void operator()() { std::exchange(strand, nullptr)->drain(true); }
+    };
+
+    void Strand::wait() noexcept {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return ! pending_; });
+    }
+
+    bool Strand::wait_until(clock::time_point t) noexcept {
+        std::unique_lock lock(mutex_);
+        return cv_.wait_until(lock, t, [this] { return ! pending_; });
+    }
+
+    void Strand::push(node* n) {
+        link(n);
+        if (pending_.fetch_add(1) == 0)
+            pool_->insert(drain_job(this));
+    }
+
+    void Strand::link(node* n) noexcept {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        auto prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    Strand::node* Strand::pop() noexcept {
+        // Returns null if the queue is empty, or if a producer has swapped
+        // the head but not yet linked its node
+        auto tail = tail_;
+        auto next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (! next)
+                return nullptr;
+            tail_ = tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (! next) {
+            if (tail != head_.load(std::memory_order_acquire))
+                return nullptr;
+            link(&stub_);
+            next = tail->next.load(std::memory_order_acquire);
+            if (! next)
+                return nullptr;
+        }
+        tail_ = next;
+        return tail;
+    }
+
+    void Strand::drain(bool run) noexcept {
+        for (int batch = 1;; ++batch) {
+            node* n;
+            while (! (n = pop()))
+                std::this_thread::yield();
+            if (run) {
+                try {
+                    n->call();
+                }
+                catch (...) {}
+            }
+            delete n;
+            // The count only reaches zero under the mutex, as in TaskGroup
+            auto count = pending_.load();
+            bool more = false;
+            while (count > 1 && ! more)
+                more = pending_.compare_exchange_weak(count, count - 1);
+            if (! more) {
+                std::unique_lock lock(mutex_);
+                if (--pending_ == 0) {
+                    cv_.notify_all();
+                    return;
+                }
+            }
+            // Yield the worker after a batch so a busy strand does not starve
+            // other jobs
+            if (run && batch >= batch_size) {
+                pool_->insert(drain_job(this));
+                return;
             }
         }
     }
@@ -1,12 +1,21 @@
 #pragma once
 
 #include "rs-io/utility.hpp"
+#include "rs-tl/enum.hpp"
 #include "rs-tl/types.hpp"
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <deque>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
 #include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <optional>
 #include <thread>
 #include <type_traits>
 #include <utility>
@@ -14,47 +23,364 @@
 
 namespace RS::IO {
 
+    template <typename T> class Future;
+    class Strand;
+    class TaskGroup;
+    class ThreadPool;
+
+    namespace Detail {
+
+        struct FutureAccess;
+
+        // Move-only type erased callable with inline storage for small
+        // function objects, falling back to the heap for large ones.
+
+        class PoolTask {
+
+        public:
+
+            static constexpr size_t size = 64;
+
+            PoolTask() = default;
+            template <typename F, typename = std::enable_if_t<! std::is_same_v<std::decay_t<F>, PoolTask>>>
+                PoolTask(F&& f);
+            ~PoolTask() noexcept { reset(); }
+            PoolTask(const PoolTask&) = delete;
+            PoolTask(PoolTask&& t) noexcept { take(t); }
+            PoolTask& operator=(const PoolTask&) = delete;
+            PoolTask& operator=(PoolTask&& t) noexcept { if (&t != this) { reset(); take(t); } return *this; }
+
+            void operator()() { ops_->call(data_); }
+            explicit operator bool() const noexcept { return ops_; }
+            void reset() noexcept { if (ops_) { ops_->destroy(data_); ops_ = nullptr; } }
+
+        private:
+
+            struct ops_type {
+                void (*call)(void* p);
+                void (*move)(void* dst, void* src) noexcept;
+                void (*destroy)(void* p) noexcept;
+            };
+
+            template <typename F> static constexpr bool fits_inline = sizeof(F) <= size - sizeof(void*)
+                && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+            template <typename F> static void call_inline(void* p) { (*static_cast<F*>(p))(); }
+            template <typename F> static void move_inline(void* dst, void* src) noexcept
+                { auto f = static_cast<F*>(src); new (dst) F(std::move(*f)); f->~F(); }
+            template <typename F> static void destroy_inline(void* p) noexcept { static_cast<F*>(p)->~F(); }
+            template <typename F> static void call_heap(void* p) { (**static_cast<F**>(p))(); }
+            template <typename F> static void move_heap(void* dst, void* src) noexcept { *static_cast<F**>(dst) = *static_cast<F**>(src); }
+            template <typename F> static void destroy_heap(void* p) noexcept { delete *static_cast<F**>(p); }
+
+            template <typename F> static constexpr ops_type inline_ops = {&call_inline<F>, &move_inline<F>, &destroy_inline<F>};
+            template <typename F> static constexpr ops_type heap_ops = {&call_heap<F>, &move_heap<F>, &destroy_heap<F>};
+
+            alignas(std::max_align_t) unsigned char data_[size - sizeof(void*)];
+            const ops_type* ops_ = nullptr;
+
+            void take(PoolTask& t) noexcept {
+                if (t.ops_) {
+                    t.ops_->move(data_, t.data_);
+                    ops_ = std::exchange(t.ops_, nullptr);
+                }
+            }
+
+        };
+
+            template <typename F, typename>
+            PoolTask::PoolTask(F&& f) {
+                using G = std::decay_t<F>;
+                if constexpr (fits_inline<G>) {
+                    new (data_) G(std::forward<F>(f));
+                    ops_ = &inline_ops<G>;
+                } else {
+                    *reinterpret_cast<G**>(data_) = new G(std::forward<F>(f));
+                    ops_ = &heap_ops<G>;
+                }
+            }
+
+        static_assert(sizeof(PoolTask) == PoolTask::size);
+
+        template <typename T>
+        class FutureState {
+        public:
+            using callback = PoolTask;
+            using value_type = std::conditional_t<std::is_void_v<T>, bool, T>;
+            bool is_ready() noexcept { std::unique_lock lock(mutex_); return ready_; }
+            void on_ready(callback f);
+            template <typename F> void run(F& f) noexcept;
+            void set_error(std::exception_ptr e) noexcept { set(std::nullopt, e); }
+            value_type take();
+            void wait() noexcept;
+            bool wait_until(std::chrono::system_clock::time_point t) noexcept;
+        private:
+            std::mutex mutex_;
+            std::condition_variable cv_;
+            std::optional<value_type> value_;
+            std::exception_ptr error_;
+            std::vector<callback> continuations_;
+            bool ready_ = false;
+            bool taken_ = false;
+            void set(std::optional<value_type>&& v, std::exception_ptr e) noexcept;
+        };
+
+            template <typename T>
+            void FutureState<T>::on_ready(callback f) {
+                {
+                    std::unique_lock lock(mutex_);
+                    if (! ready_) {
+                        continuations_.push_back(std::move(f));
+                        return;
+                    }
+                }
+                f();
+            }
+
+            template <typename T>
+            template <typename F>
+            void FutureState<T>::run(F& f) noexcept {
+                try {
+                    if constexpr (std::is_void_v<T>) {
+                        f();
+                        set(true, nullptr);
+                    } else {
+                        set(f(), nullptr);
+                    }
+                }
+                catch (...) {
+                    set(std::nullopt, std::current_exception());
+                }
+            }
+
+            template <typename T>
+            typename FutureState<T>::value_type FutureState<T>::take() {
+                // The result is moved out, so copies of a future can only
+                // take it once between them
+                {
+                    std::unique_lock lock(mutex_);
+                    cv_.wait(lock, [this] { return ready_; });
+                    if (taken_)
+                        throw std::future_error(std::future_errc::future_already_retrieved);
+                    taken_ = true;
+                }
+                if (error_)
+                    std::rethrow_exception(error_);
+                return std::move(*value_);
+            }
+
+            template <typename T>
+            void FutureState<T>::wait() noexcept {
+                std::unique_lock lock(mutex_);
+                cv_.wait(lock, [this] { return ready_; });
+            }
+
+            template <typename T>
+            bool FutureState<T>::wait_until(std::chrono::system_clock::time_point t) noexcept {
+                std::unique_lock lock(mutex_);
+                return cv_.wait_until(lock, t, [this] { return ready_; });
+            }
+
+            template <typename T>
+            void FutureState<T>::set(std::optional<value_type>&& v, std::exception_ptr e) noexcept {
+                std::vector<callback> calls;
+                {
+                    std::unique_lock lock(mutex_);
+                    if (ready_)
+                        return;
+                    value_ = std::move(v);
+                    error_ = e;
+                    ready_ = true;
+                    calls.swap(continuations_);
+                    cv_.notify_all();
+                }
+                for (auto& call: calls)
+                    call();
+            }
+
+        template <typename F, typename T> struct ThenResultType { using type = std::invoke_result_t<F&, T>; };
+        template <typename F> struct ThenResultType<F, void> { using type = std::invoke_result_t<F&>; };
+        template <typename F, typename T> using ThenResult = typename ThenResultType<F, T>::type;
+
+        // Holds the promise side of a future inside a queued job; if the job
+        // is discarded without being run, the future is broken.
+
+        template <typename T, typename F>
+        class FutureJob {
+        public:
+            FutureJob(std::shared_ptr<FutureState<T>> state, F&& f): state_(std::move(state)), f_(std::move(f)) {}
+            ~FutureJob() noexcept {
+                if (state_)
+                    state_->set_error(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+            FutureJob(const FutureJob&) = delete;
+            FutureJob(FutureJob&&) = default;
+            FutureJob& operator=(const FutureJob&) = delete;
+            FutureJob& operator=(FutureJob&&) = delete;
+            void operator()() { state_->run(f_); state_.reset(); }
+        private:
+            std::shared_ptr<FutureState<T>> state_;
+            F f_;
+        };
+
+    }
+
     class ThreadPool {
 
     public:
 
         using clock = std::chrono::system_clock;
 
+        enum class flag: int {
+            none  = 0,
+            numa  = 1 << 0,  // Group workers by NUMA node, prefer local stealing
+            pin   = 1 << 1,  // Pin each worker to one CPU
+            stats = 1 << 2,  // Collect statistics
+        };
+
+        enum class priority: int {
+            high,
+            normal,
+            low,
+        };
+
+        // Log-linear histogram of durations, with 8 sub-buckets per power of
+        // 2, giving a resolution of 1/8 of the value.
+
+        class histogram {
+        public:
+            static constexpr int sub_bits = 3;
+            static constexpr int sub_buckets = 1 << sub_bits;
+            static constexpr int buckets = 62 * sub_buckets;
+            histogram(): counts_(buckets, 0) {}
+            uint64_t count() const noexcept;
+            std::chrono::nanoseconds max() const noexcept;
+            std::chrono::nanoseconds mean() const noexcept;
+            std::chrono::nanoseconds percentile(double p) const noexcept;
+            static int bucket(uint64_t ns) noexcept;
+            static uint64_t lower_bound(int bucket) noexcept;
+            static uint64_t upper_bound(int bucket) noexcept;
+        private:
+            friend class ThreadPool;
+            std::vector<uint64_t> counts_;
+        };
+
+        struct worker_stats {
+            uint64_t jobs = 0;                 // Jobs run by this worker
+            uint64_t steals = 0;               // Jobs stolen from other workers
+            uint64_t failed_steals = 0;        // Searches of other workers that found nothing
+            std::chrono::nanoseconds idle {};  // Time spent looking for work or asleep
+        };
+
+        struct statistics {
+            std::vector<worker_stats> workers;
+            uint64_t helper_jobs = 0;  // Jobs run by threads in wait(true)
+            histogram queue_latency;   // Time from insertion to start
+            histogram run_time;        // Job execution time
+        };
+
         ThreadPool(): ThreadPool(0) {}
-        explicit ThreadPool(int threads);
+        explicit ThreadPool(int threads, flag flags = flag::none): ThreadPool(threads, threads, flags) {}
+        ThreadPool(int min_threads, int max_threads, flag flags = flag::none);
         ~ThreadPool() noexcept;
         ThreadPool(const ThreadPool&) = delete;
         ThreadPool(ThreadPool&&) = delete;
         ThreadPool& operator=(const ThreadPool&) = delete;
         ThreadPool& operator=(ThreadPool&&) = delete;
 
-        int threads() const noexcept { return int(workers_.size()); }
+        int threads() const noexcept { return running_; }
+        int min_threads() const noexcept { return min_threads_; }
+        int max_threads() const noexcept { return int(workers_.size()); }
+        int nodes() const noexcept { return nodes_; }
+        static ThreadPool* current() noexcept;
+        void set_block_threshold(std::chrono::nanoseconds t) noexcept { block_threshold_ = t.count(); }
+        void set_idle_timeout(std::chrono::nanoseconds t) noexcept { idle_timeout_ = t.count(); }
+        statistics stats() const;
         template <typename F> void insert(F&& f);
+        template <typename F> void insert(priority p, F&& f);
+        template <typename F> void insert(clock::time_point deadline, F&& f);
+        template <typename F> Future<std::invoke_result_t<std::decay_t<F>&>> submit(F&& f);
         template <typename F> void each(int n, F&& f) { each(0, 1, n, std::forward<F>(f)); }
         template <typename F> void each(int start, int delta, int stop, F&& f);
         template <typename Range, typename F> void each(Range& range, F&& f);
+        template <typename F> void each_chunk(int n, F&& f) { each_chunk(0, n, 0, std::forward<F>(f)); }
+        template <typename F> void each_chunk(int start, int stop, int grain, F&& f);
         void clear() noexcept;
+        int queue_depth(priority p) const noexcept;
+        int deadline_depth() const noexcept;
         bool poll() { return ! unfinished_jobs_; }
         void wait() noexcept;
+        void wait(bool help) noexcept;
         template <typename R, typename P> bool wait_for(std::chrono::duration<R, P> t) noexcept;
         bool wait_until(clock::time_point t) noexcept;
 
     private:
 
-        using callback = std::function<void()>;
+        friend class Strand;
+        friend class TaskGroup;
 
-        struct worker {
-            std::mutex mutex;
-            std::deque<callback> queue;
-            std::thread thread;
-        };
+        using callback = Detail::PoolTask;
+
+        struct job_info;
+        struct lane_queues;
+        struct stats_counters;
+        struct worker;
+
+        static constexpr int deadline_lane = 0;
+        static constexpr int high_lane = 1;
+        static constexpr int normal_lane = 2;
+        static constexpr int low_lane = 3;
+        static constexpr int lane_count = 4;
 
         std::atomic<int> clear_count_;
+        std::atomic<int> outside_pushes_;
         std::atomic<int> next_worker_;
         std::atomic<int> unfinished_jobs_;
+        std::atomic<int> queued_jobs_;
+        std::atomic<int> idle_threads_;
+        std::atomic<int> helpers_;
         std::atomic<bool> shutting_down_;
-        std::vector<worker> workers_;
+        std::atomic<int> running_;
+        std::atomic<bool> monitor_idle_;
+        std::atomic<int64_t> block_threshold_;
+        std::atomic<int64_t> idle_timeout_;
+        std::mutex idle_mutex_;
+        std::condition_variable idle_cv_;
+        std::mutex done_mutex_;
+        std::condition_variable done_cv_;
+        std::mutex resize_mutex_;
+        std::mutex monitor_mutex_;
+        std::condition_variable monitor_cv_;
+        std::thread monitor_;
+        std::vector<std::unique_ptr<worker>> workers_;
+        std::unique_ptr<lane_queues> lanes_;
+        std::unique_ptr<stats_counters> helper_stats_;
+        int min_threads_;
+        int nodes_;
+        flag flags_;
+
+        static thread_local worker* current_worker_;
+
+        void drop_job(job_info& job) noexcept;
+        bool find_job(worker* work, job_info& job, int victim);
+        bool steal_job(worker* work, job_info& job, int victim);
+        bool take_lane(int lane, job_info& job);
+        bool take_normal(worker* work, job_info& job, int victim);
+        bool elastic() const noexcept { return min_threads_ < max_threads(); }
+        void jobs_done(int n) noexcept;
+        void monitor_payload() noexcept;
+        void place_workers(flag flags);
+        void push_job(callback&& call, TaskGroup* group = nullptr, int lane = normal_lane, clock::time_point deadline = {});
+        void run_job(job_info& job) noexcept;
+        void start_worker(worker& work);
+        bool try_retire() noexcept;
+        void unqueue(int lane, int n = 1) noexcept;
+        void wake_one() noexcept;
 
+        template <typename FP> void insert_chunk(int start, int stop, int grain, const FP& fp);
+
+        static job_info* alloc_job(job_info&& job);
+        static void free_job(job_info* job) noexcept;
         static int adjust_threads(int threads) noexcept;
         static void thread_payload(ThreadPool* pool, worker* work) noexcept;
 
@@ -62,14 +388,25 @@ namespace RS::IO {
 
         template <typename F>
         void ThreadPool::insert(F&& f) {
-            if (clear_count_)
-                return;
-            int index = next_worker_;
-            next_worker_ = (index + 1) % threads();
-            auto& work = workers_[index];
-            std::unique_lock lock(work.mutex);
-            ++unfinished_jobs_;
-            work.queue.emplace_back(std::forward<F>(f));
+            push_job(callback(std::forward<F>(f)));
+        }
+
+        template <typename F>
+        void ThreadPool::insert(priority p, F&& f) {
+            push_job(callback(std::forward<F>(f)), nullptr, high_lane + int(p));
+        }
+
+        template <typename F>
+        void ThreadPool::insert(clock::time_point deadline, F&& f) {
+            push_job(callback(std::forward<F>(f)), nullptr, deadline_lane, deadline);
+        }
+
+        template <typename F>
+        Future<std::invoke_result_t<std::decay_t<F>&>> ThreadPool::submit(F&& f) {
+            using T = std::invoke_result_t<std::decay_t<F>&>;
+            auto state = std::make_shared<Detail::FutureState<T>>();
+            insert(Detail::FutureJob<T, std::decay_t<F>>(state, std::decay_t<F>(std::forward<F>(f))));
+            return Future<T>(*this, state);
         }
 
         template <typename F>
@@ -102,9 +439,217 @@ namespace RS::IO {
             }
         }
 
+        template <typename F>
+        void ThreadPool::each_chunk(int start, int stop, int grain, F&& f) {
+            static constexpr int chunks_per_thread = 8;
+            if (start >= stop)
+                return;
+            if (grain <= 0) {
+                auto n = (int64_t(stop) - int64_t(start)) / (chunks_per_thread * threads());
+                grain = int(std::max(n, int64_t(1)));
+            }
+            auto fp = std::make_shared<std::decay_t<F>>(std::forward<F>(f));
+            insert_chunk(start, stop, grain, fp);
+        }
+
+        template <typename FP>
+        void ThreadPool::insert_chunk(int start, int stop, int grain, const FP& fp) {
+            // Split off the upper half until the remainder is no bigger than
+            // the grain size. When called from inside a job, the split halves
+            // go onto the current worker's deque, where idle workers can
+            // steal them (largest first).
+            insert([this,start,stop,grain,fp] {
+                int lo = start, hi = stop;
+                while (int64_t(hi) - int64_t(lo) > grain) {
+                    int mid = int(lo + (int64_t(hi) - int64_t(lo)) / 2);
+                    insert_chunk(mid, hi, grain, fp);
+                    hi = mid;
+                }
+                auto& f = *fp;
+                if constexpr (std::is_invocable_v<decltype(f), int, int>) {
+                    f(lo, hi);
+                } else {
+                    for (int i = lo; i < hi; ++i)
+                        f(i);
+                }
+            });
+        }
+
         template <typename R, typename P>
         bool ThreadPool::wait_for(std::chrono::duration<R, P> t) noexcept {
             return wait_until(clock::now() + t);
         }
 
+    RS_DEFINE_BITMASK_OPERATORS(ThreadPool::flag);
+
+    class TaskGroup {
+
+    public:
+
+        using clock = ThreadPool::clock;
+
+        explicit TaskGroup(ThreadPool& pool) noexcept: pool_(&pool) {}
+        ~TaskGroup() noexcept { cancel(); }
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup(TaskGroup&&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+        TaskGroup& operator=(TaskGroup&&) = delete;
+
+        ThreadPool& pool() const noexcept { return *pool_; }
+        template <typename F> void insert(F&& f) { pool_->push_job(ThreadPool::callback(std::forward<F>(f)), this); }
+        void cancel() noexcept;
+        bool poll() { return ! unfinished_jobs_; }
+        void wait() noexcept;
+        template <typename R, typename P> bool wait_for(std::chrono::duration<R, P> t) noexcept;
+        bool wait_until(clock::time_point t) noexcept;
+
+    private:
+
+        friend class ThreadPool;
+
+        ThreadPool* pool_;
+        std::atomic<int> unfinished_jobs_ {0};
+        std::atomic<unsigned> generation_ {0};
+        std::mutex mutex_;
+        std::condition_variable cv_;
+
+        void job_done() noexcept;
+
+    };
+
+        template <typename R, typename P>
+        bool TaskGroup::wait_for(std::chrono::duration<R, P> t) noexcept {
+            return wait_until(clock::now() + t);
+        }
+
+    class Strand {
+
+    public:
+
+        using clock = ThreadPool::clock;
+
+        explicit Strand(ThreadPool& pool) noexcept: pool_(&pool) {}
+        ~Strand() noexcept { wait(); }
+        Strand(const Strand&) = delete;
+        Strand(Strand&&) = delete;
+        Strand& operator=(const Strand&) = delete;
+        Strand& operator=(Strand&&) = delete;
+
+        ThreadPool& pool() const noexcept { return *pool_; }
+        template <typename F> void insert(F&& f) { push(new node(ThreadPool::callback(std::forward<F>(f)))); }
+        bool poll() { return ! pending_; }
+        void wait() noexcept;
+        template <typename R, typename P> bool wait_for(std::chrono::duration<R, P> t) noexcept;
+        bool wait_until(clock::time_point t) noexcept;
+
+    private:
+
+        // Tasks are held in an intrusive multi-producer single-consumer
+        // queue; pending counts tasks inserted but not yet finished, and
+        // whoever raises it from zero schedules the drain job
+
+        struct drain_job;
+
+        struct node {
+            std::atomic<node*> next {nullptr};
+            ThreadPool::callback call;
+            node() = default;
+            explicit node(ThreadPool::callback&& c) noexcept: call(std::move(c)) {}
+        };
+
+        static constexpr int batch_size = 64;
+
+        ThreadPool* pool_;
+        node stub_;
+        std::atomic<node*> head_ {&stub_};
+        node* tail_ = &stub_;
+        std::atomic<size_t> pending_ {0};
+        std::mutex mutex_;
+        std::condition_variable cv_;
+
+        void push(node* n);
+        void link(node* n) noexcept;
+        node* pop() noexcept;
+        void drain(bool run) noexcept;
+
+    };
+
+        template <typename R, typename P>
+        bool Strand::wait_for(std::chrono::duration<R, P> t) noexcept {
+            return wait_until(clock::now() + t);
+        }
+
+    template <typename T>
+    class Future {
+
+    public:
+
+        using clock = ThreadPool::clock;
+        using value_type = T;
+
+        Future() = default;
+
+        T get();
+        bool poll() const noexcept { return state_ && state_->is_ready(); }
+        template <typename F> Future<Detail::ThenResult<std::decay_t<F>, T>> then(F&& f);
+        bool valid() const noexcept { return bool(state_); }
+        void wait() const noexcept { if (state_) state_->wait(); }
+        template <typename R, typename P> bool wait_for(std::chrono::duration<R, P> t) const noexcept;
+        bool wait_until(clock::time_point t) const noexcept { return ! state_ || state_->wait_until(t); }
+
+    private:
+
+        friend class ThreadPool;
+        friend struct Detail::FutureAccess;
+        template <typename U> friend class Future;
+
+        using state_type = Detail::FutureState<T>;
+
+        ThreadPool* pool_ = nullptr;
+        std::shared_ptr<state_type> state_;
+
+        Future(ThreadPool& pool, std::shared_ptr<state_type> state) noexcept: pool_(&pool), state_(std::move(state)) {}
+
+    };
+
+        template <typename T>
+        T Future<T>::get() {
+            if (! state_)
+                throw std::future_error(std::future_errc::no_state);
+            auto state = std::move(state_);
+            if constexpr (std::is_void_v<T>)
+                state->take();
+            else
+                return state->take();
+        }
+
+        template <typename T>
+        template <typename F>
+        Future<Detail::ThenResult<std::decay_t<F>, T>> Future<T>::then(F&& f) {
+            using U = Detail::ThenResult<std::decay_t<F>, T>;
+            if (! state_)
+                throw std::future_error(std::future_errc::no_state);
+            auto pool = pool_;
+            auto prev = std::move(state_);
+            auto next = std::make_shared<Detail::FutureState<U>>();
+            auto call = [prev,f=std::decay_t<F>(std::forward<F>(f))] () mutable -> U {
+                if constexpr (std::is_void_v<T>) {
+                    prev->take();
+                    return f();
+                } else {
+                    return f(prev->take());
+                }
+            };
+            prev->on_ready([pool,next,call=std::move(call)] () mutable {
+                pool->insert(Detail::FutureJob<U, decltype(call)>(next, std::move(call)));
+            });
+            return Future<U>(*pool, next);
+        }
+
+        template <typename T>
+        template <typename R, typename P>
+        bool Future<T>::wait_for(std::chrono::duration<R, P> t) const noexcept {
+            return wait_until(clock::now() + t);
+        }
+
 }
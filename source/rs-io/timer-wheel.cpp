@@ -0,0 +1,299 @@
+#include "rs-io/timer-wheel.hpp"
+#include "rs-tl/guard.hpp"
+#include <algorithm>
+#include <limits>
+
+using namespace std::chrono;
+
+namespace RS::IO {
+
+    namespace {
+
+        constexpr uint64_t no_tick = std::numeric_limits<uint64_t>::max();
+
+        int lowest_bit(uint64_t x) noexcept {
+            #ifdef __GNUC__
+                return __builtin_ctzll(x);
+            #else
+                int i = 0;
+                for (; (x & 1) == 0; x >>= 1)
+                    ++i;
+                return i;
+            #endif
+        }
+
+    }
+
+    // Class TimerWheel
+
+    TimerWheel::TimerWheel(duration resolution):
+    resolution_(std::max(resolution, duration(1))),
+    start_(clock::now()) {}
+
+    TimerWheel::~TimerWheel() noexcept {
+        stop();
+        std::unique_lock lock(mutex_);
+        auto release = [this] (timer& t) {
+            unlink(t);
+            t.wheel_ = nullptr;
+        };
+        while (expired_)
+            release(*expired_);
+        for (auto& level: slots_)
+            for (auto& slot: level)
+                while (slot)
+                    release(*slot);
+    }
+
+    size_t TimerWheel::advance() {
+        std::unique_lock lock(mutex_);
+        return run_until(lock, tick_before(clock::now()));
+    }
+
+    TimerWheel::duration TimerWheel::next_timeout() const noexcept {
+        std::unique_lock lock(mutex_);
+        if (count_ == 0)
+            return duration::max();
+        if (expired_)
+            return {};
+        auto t = start_ + resolution_ * int64_t(next_tick());
+        return std::max(duration(t - clock::now()), duration());
+    }
+
+    size_t TimerWheel::size() const noexcept {
+        std::unique_lock lock(mutex_);
+        return count_;
+    }
+
+    void TimerWheel::start() {
+        std::unique_lock lock(mutex_);
+        if (running_)
+            return;
+        running_ = true;
+        thread_ = std::thread([this] {
+            std::unique_lock lock(mutex_);
+            while (running_) {
+                run_until(lock, tick_before(clock::now()));
+                if (! running_)
+                    break;
+                sleep_until_ = count_ == 0 ? no_tick : next_tick();
+                if (sleep_until_ == no_tick)
+                    cv_.wait(lock);
+                else
+                    cv_.wait_until(lock, start_ + resolution_ * int64_t(sleep_until_));
+                sleep_until_ = 0;
+            }
+        });
+    }
+
+    void TimerWheel::stop() noexcept {
+        {
+            std::unique_lock lock(mutex_);
+            running_ = false;
+            cv_.notify_all();
+        }
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    void TimerWheel::insert(timer& t) noexcept {
+        // Each timer lives on the lowest level whose higher digits match
+        // the current tick, so it cascades down once per level at most
+        int level = 0;
+        while (level < levels - 1 && (t.expiry_ >> (level_bits * (level + 1))) != (now_ >> (level_bits * (level + 1))))
+            ++level;
+        int slot = int(t.expiry_ >> (level_bits * level)) & (slots - 1);
+        t.level_ = level;
+        t.prev_ = nullptr;
+        t.next_ = slots_[level][slot];
+        if (t.next_)
+            t.next_->prev_ = &t;
+        slots_[level][slot] = &t;
+        masks_[level] |= uint64_t(1) << slot;
+    }
+
+    void TimerWheel::unlink(timer& t) noexcept {
+        auto& first = head(t);
+        if (t.prev_)
+            t.prev_->next_ = t.next_;
+        else
+            first = t.next_;
+        if (t.next_)
+            t.next_->prev_ = t.prev_;
+        if (t.level_ < levels && ! first)
+            masks_[t.level_] &= ~(uint64_t(1) << (int(t.expiry_ >> (level_bits * t.level_)) & (slots - 1)));
+        t.prev_ = t.next_ = nullptr;
+        t.level_ = -1;
+        --count_;
+    }
+
+    TimerWheel::timer*& TimerWheel::head(const timer& t) noexcept {
+        if (t.level_ == levels)
+            return expired_;
+        return slots_[t.level_][int(t.expiry_ >> (level_bits * t.level_)) & (slots - 1)];
+    }
+
+    uint64_t TimerWheel::next_tick() const noexcept {
+        // Earliest tick after now_ that has a timer to fire or cascade
+        uint64_t next = no_tick;
+        for (int level = 0; level < levels; ++level) {
+            uint64_t mask = masks_[level];
+            if (mask == 0)
+                continue;
+            uint64_t base = (now_ >> (level_bits * level)) + 1;
+            int shift = int(base & (slots - 1));
+            if (shift != 0)
+                mask = (mask >> shift) | (mask << (slots - shift));
+            uint64_t tick = (base + lowest_bit(mask)) << (level_bits * level);
+            next = std::min(next, tick);
+        }
+        return next;
+    }
+
+    uint64_t TimerWheel::tick_after(time_point t) const noexcept {
+        auto d = (t - start_).count();
+        if (d <= 0)
+            return 0;
+        auto r = resolution_.count();
+        return uint64_t((d + r - 1) / r);
+    }
+
+    uint64_t TimerWheel::tick_before(time_point t) const noexcept {
+        auto d = (t - start_).count();
+        return d <= 0 ? 0 : uint64_t(d / resolution_.count());
+    }
+
+    size_t TimerWheel::run_until(std::unique_lock<std::mutex>& lock, uint64_t target) {
+        size_t fired = 0;
+        while (now_ < target || expired_) {
+            if (! expired_) {
+                uint64_t next = next_tick();
+                if (next > target) {
+                    now_ = target;
+                    break;
+                }
+                now_ = next;
+                for (int level = levels - 1; level >= 0; --level) {
+                    if (level > 0 && (now_ & ((uint64_t(1) << (level_bits * level)) - 1)) != 0)
+                        continue;
+                    int slot = int(now_ >> (level_bits * level)) & (slots - 1);
+                    auto list = slots_[level][slot];
+                    if (! list)
+                        continue;
+                    slots_[level][slot] = nullptr;
+                    masks_[level] &= ~(uint64_t(1) << slot);
+                    while (list) {
+                        auto& t = *list;
+                        list = t.next_;
+                        if (t.expiry_ <= now_) {
+                            t.level_ = levels;
+                            t.prev_ = nullptr;
+                            t.next_ = expired_;
+                            if (expired_)
+                                expired_->prev_ = &t;
+                            expired_ = &t;
+                        } else {
+                            insert(t);
+                        }
+                    }
+                }
+            }
+            while (expired_) {
+                // Each thread driving the wheel records its own callback, so
+                // cancel() can wait for any of them. A timer whose callback
+                // is still running elsewhere waits for it to finish, so no
+                // callback runs concurrently with itself.
+                auto& t = *expired_;
+                if (firing_elsewhere(t)) {
+                    cv_.wait(lock);
+                    continue;
+                }
+                auto self = std::this_thread::get_id();
+                firing_.push_back({&t, self});
+                unlink(t);
+                ++fired;
+                // The callback is moved out while it runs, and the timer is
+                // not touched again unless the callback leaves it alone, so
+                // the callback may destroy its own timer
+                auto call = std::move(t.callback_);
+                lock.unlock();
+                auto guard = TL::on_scope_exit([&] {
+                    lock.lock();
+                    auto it = std::find_if(firing_.rbegin(), firing_.rend(),
+                        [&] (auto& f) { return f.target == &t && f.thread == self; });
+                    if (! it->released) {
+                        if (! t.callback_)
+                            t.callback_ = std::move(call);
+                        if (t.level_ < 0 && t.wheel_ == this)
+                            t.wheel_ = nullptr;
+                    }
+                    firing_.erase(std::next(it).base());
+                    cv_.notify_all();
+                });
+                if (call)
+                    call();
+            }
+        }
+        return fired;
+    }
+
+    bool TimerWheel::firing_elsewhere(const timer& t) const noexcept {
+        auto self = std::this_thread::get_id();
+        return std::any_of(firing_.begin(), firing_.end(),
+            [&] (auto& f) { return f.target == &t && f.thread != self; });
+    }
+
+    // Class TimerWheel::timer
+
+    void TimerWheel::timer::arm(TimerWheel& wheel, duration delay) {
+        if (wheel_ && wheel_ != &wheel)
+            cancel();
+        auto when = clock::now() + std::max(delay, duration());
+        std::unique_lock lock(wheel.mutex_);
+        if (level_ >= 0)
+            wheel.unlink(*this);
+        auto ticks = std::max(wheel.tick_after(when), wheel.now_ + 1);
+        expiry_ = std::min(ticks, wheel.now_ + max_ticks);
+        wheel_ = &wheel;
+        wheel.insert(*this);
+        ++wheel.count_;
+        if (wheel.running_ && expiry_ < wheel.sleep_until_)
+            wheel.cv_.notify_all();
+    }
+
+    bool TimerWheel::timer::do_cancel(bool destroying) noexcept {
+        TimerWheel* wheel = wheel_;
+        if (! wheel)
+            return false;
+        std::unique_lock lock(wheel->mutex_);
+        bool armed = level_ >= 0;
+        if (armed)
+            wheel->unlink(*this);
+        wheel->cv_.wait(lock, [&] { return ! wheel->firing_elsewhere(*this); });
+        // A timer destroyed by its own callback must be left alone by the
+        // thread that is running it
+        if (destroying) {
+            auto self = std::this_thread::get_id();
+            for (auto& f: wheel->firing_)
+                if (f.target == this && f.thread == self)
+                    f.released = true;
+        }
+        if (level_ < 0)
+            wheel_ = nullptr;
+        return armed;
+    }
+
+    bool TimerWheel::timer::is_armed() const noexcept {
+        TimerWheel* wheel = wheel_;
+        if (! wheel)
+            return false;
+        std::unique_lock lock(wheel->mutex_);
+        return level_ >= 0;
+    }
+
+    void TimerWheel::timer::set_callback(callback f) {
+        cancel();
+        callback_ = std::move(f);
+    }
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "rs-io/utility.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RS::IO {
+
+    class TimerWheel {
+
+    public:
+
+        using clock = std::chrono::system_clock;
+        using duration = clock::duration;
+        using time_point = clock::time_point;
+
+        class timer;
+
+        explicit TimerWheel(duration resolution = std::chrono::milliseconds(1));
+        ~TimerWheel() noexcept;
+        TimerWheel(const TimerWheel&) = delete;
+        TimerWheel(TimerWheel&&) = delete;
+        TimerWheel& operator=(const TimerWheel&) = delete;
+        TimerWheel& operator=(TimerWheel&&) = delete;
+
+        size_t advance();
+        bool empty() const noexcept { return size() == 0; }
+        duration next_timeout() const noexcept;
+        duration resolution() const noexcept { return resolution_; }
+        size_t size() const noexcept;
+        void start();
+        void stop() noexcept;
+
+    private:
+
+        static constexpr int level_bits = 6;
+        static constexpr int slots = 1 << level_bits;
+        static constexpr int levels = 8;
+        static constexpr uint64_t max_ticks = (uint64_t(1) << (level_bits * levels - 1)) - 1;
+
+        struct firing_info {
+            const timer* target;
+            std::thread::id thread;
+            bool released = false; // Destroyed by its own callback
+        };
+
+        mutable std::mutex mutex_;
+        std::condition_variable cv_;
+        duration resolution_;
+        time_point start_;
+        uint64_t now_ = 0; // Last tick processed
+        uint64_t masks_[levels] = {};
+        timer* slots_[levels][slots] = {};
+        timer* expired_ = nullptr;
+        size_t count_ = 0;
+        std::vector<firing_info> firing_; // Callbacks in progress
+        std::thread thread_;
+        uint64_t sleep_until_ = 0;
+        bool running_ = false;
+
+        void insert(timer& t) noexcept;
+        void unlink(timer& t) noexcept;
+        timer*& head(const timer& t) noexcept;
+        uint64_t next_tick() const noexcept;
+        uint64_t tick_after(time_point t) const noexcept;
+        uint64_t tick_before(time_point t) const noexcept;
+        size_t run_until(std::unique_lock<std::mutex>& lock, uint64_t target);
+        bool firing_elsewhere(const timer& t) const noexcept;
+
+    };
+
+    class TimerWheel::timer {
+
+    public:
+
+        using callback = std::function<void()>;
+
+        timer() = default;
+        explicit timer(callback f): callback_(std::move(f)) {}
+        ~timer() noexcept { do_cancel(true); }
+        timer(const timer&) = delete;
+        timer(timer&&) = delete;
+        timer& operator=(const timer&) = delete;
+        timer& operator=(timer&&) = delete;
+
+        void arm(TimerWheel& wheel, duration delay);
+        bool cancel() noexcept { return do_cancel(false); }
+        bool is_armed() const noexcept;
+        void set_callback(callback f);
+
+    private:
+
+        friend class TimerWheel;
+
+        std::atomic<TimerWheel*> wheel_ {nullptr};
+        callback callback_;
+        uint64_t expiry_ = 0;
+        timer* prev_ = nullptr;
+        timer* next_ = nullptr;
+        int level_ = -1; // -1 = not armed, levels = expired
+
+        bool do_cancel(bool destroying) noexcept;
+
+    };
+
+}
@@ -1,9 +1,15 @@
 #include "rs-io/channel.hpp"
 #include "rs-unit-test.hpp"
+#include <atomic>
 #include <chrono>
+#include <iostream>
+#include <iterator>
+#include <memory>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
 using namespace RS::IO;
 using namespace std::chrono;
@@ -91,6 +97,104 @@ void test_rs_io_channel_buffer() {
 
 }
 
+void test_rs_io_channel_buffer_spans() {
+
+    BufferChannel chan;
+    std::vector<std::string_view> views;
+    std::string s;
+    size_t n = 0;
+
+    TRY(views = chan.peek());
+    TEST(views.empty());
+    TEST(chan.empty());
+
+    TEST(chan.writev({"Hello ", "world", "!"}));
+    TEST_EQUAL(chan.size(), 12u);
+    TEST(chan.wait_for(10ms));
+    TRY(views = chan.peek());
+    TEST_EQUAL(views.size(), 1u);
+    TEST_EQUAL(views[0], "Hello world!");
+    TRY(views = chan.peek(5));
+    TEST_EQUAL(views.size(), 1u);
+    TEST_EQUAL(views[0], "Hello");
+    TRY(n = chan.consume(6));
+    TEST_EQUAL(n, 6u);
+    TRY(views = chan.peek());
+    TEST_EQUAL(views.size(), 1u);
+    TEST_EQUAL(views[0], "world!");
+
+    std::string big(100'000, 'x');
+    const char* big_data = big.data();
+    TEST(chan.adopt(std::move(big)));
+    TEST_EQUAL(chan.size(), 100'006u);
+    TRY(views = chan.peek());
+    TEST_EQUAL(views.size(), 2u);
+    TEST_EQUAL(views[0], "world!");
+    TEST_EQUAL(views[1].size(), 100'000u);
+    TEST_EQUAL(views[1].data(), big_data);
+    TEST(chan.write("abc"));
+    TRY(views = chan.peek());
+    TEST_EQUAL(views.size(), 3u);
+    TEST_EQUAL(views[2], "abc");
+
+    TRY(n = chan.consume(100'000));
+    TEST_EQUAL(n, 100'000u);
+    TRY(views = chan.peek());
+    TEST_EQUAL(views.size(), 2u);
+    TEST_EQUAL(views[0], "xxxxxx");
+    TEST_EQUAL(views[1], "abc");
+    TRY(chan.append(s));
+    TEST_EQUAL(s, "xxxxxxabc");
+    TEST(chan.empty());
+    TEST(! chan.wait_for(10ms));
+    TRY(n = chan.consume(10));
+    TEST_EQUAL(n, 0u);
+
+    TEST(chan.write("Hello"));
+    TRY(chan.clear());
+    TEST(chan.empty());
+    TRY(chan.close());
+    TEST(! chan.write("Hello"));
+    TEST(! chan.adopt("Hello"));
+    TEST(! chan.writev({"Hello", "world"}));
+
+}
+
+void test_rs_io_channel_buffer_streaming() {
+
+    static constexpr size_t block = 65536;
+    static constexpr size_t count = 4096;
+
+    BufferChannel chan;
+    size_t total = 0;
+    bool ok = true;
+
+    auto t0 = system_clock::now();
+    auto t = std::thread([&] {
+        std::string block_data(block, '\0');
+        for (size_t i = 0; i < count; ++i) {
+            block_data.assign(block, char('a' + i % 26));
+            chan.write(block_data);
+        }
+    });
+    while (total < block * count && chan.wait_for(1s)) {
+        for (auto view: chan.peek()) {
+            for (size_t i = 0; i < view.size(); i += 4096)
+                ok &= view[i] == char('a' + (total + i) / block % 26);
+            total += view.size();
+            chan.consume(view.size());
+        }
+    }
+    TRY(t.join());
+    auto t1 = system_clock::now();
+    TEST_EQUAL(total, block * count);
+    TEST(ok);
+    double mb = double(block * count) / 1048576.0;
+    double sec = duration<double>(t1 - t0).count();
+    std::cout << "... BufferChannel throughput = " << int(mb / sec) << " MB/s" << std::endl;
+
+}
+
 void test_rs_io_channel_queue() {
 
     QueueChannel<std::string> chan;
@@ -120,6 +224,44 @@ void test_rs_io_channel_queue() {
 
 }
 
+void test_rs_io_channel_queue_batch() {
+
+    QueueChannel<std::string> chan;
+    std::vector<std::string> v = {"alpha", "bravo", "charlie"}, w;
+    std::string s;
+    size_t n = 0;
+
+    TEST(chan.write_batch(v));
+    TEST_EQUAL(v.size(), 3u);
+    TEST_EQUAL(v[0], "alpha");
+    TEST(chan.write_batch(std::vector<std::string>{"delta", "echo"}));
+    TEST(chan.wait_for(10ms));
+
+    TRY(n = chan.read_batch(std::back_inserter(w), 2));
+    TEST_EQUAL(n, 2u);
+    TRY(s = RS::UnitTest::format_range(w));
+    TEST_EQUAL(s, "[alpha,bravo]");
+    TEST(chan.wait_for(10ms));
+
+    w.clear();
+    TRY(n = chan.read_batch(std::back_inserter(w)));
+    TEST_EQUAL(n, 3u);
+    TRY(s = RS::UnitTest::format_range(w));
+    TEST_EQUAL(s, "[charlie,delta,echo]");
+    TEST(! chan.wait_for(10ms));
+
+    w.clear();
+    TRY(n = chan.read_batch(std::back_inserter(w)));
+    TEST_EQUAL(n, 0u);
+    TEST(w.empty());
+
+    TRY(chan.close());
+    TEST(! chan.write_batch(v));
+    TEST(chan.wait_for(10ms));
+    TEST(chan.is_closed());
+
+}
+
 void test_rs_io_channel_value() {
 
     ValueChannel<std::string> chan;
@@ -171,3 +313,443 @@ void test_rs_io_channel_timer() {
     TEST(chan1.is_closed());
 
 }
+
+void test_rs_io_channel_bounded_queue() {
+
+    BoundedQueueChannel<std::string> chan(3);
+    std::string s;
+
+    TEST_EQUAL(chan.capacity(), 4u);
+    TEST(chan.empty());
+    TEST(! chan.wait_for(10ms));
+
+    TEST(chan.write("Hello"));
+    TEST_EQUAL(chan.size(), 1u);
+    TEST(chan.wait_for(10ms));
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "Hello");
+    TEST(! chan.wait_for(10ms));
+
+    TEST(chan.try_write("alpha"));
+    TEST(chan.try_write("bravo"));
+    TEST(chan.try_write("charlie"));
+    TEST(chan.try_write("delta"));
+    TEST(! chan.try_write("echo"));
+    TEST(! chan.write_for("echo", 10ms));
+    TEST_EQUAL(chan.size(), 4u);
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "alpha");
+    TEST(chan.write_for("echo", 10ms));
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "bravo");
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "charlie");
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "delta");
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "echo");
+    TEST(! chan.read(s));
+    TEST(chan.empty());
+
+    for (int i = 0; i < 4; ++i)
+        TEST(chan.try_write("x"));
+    auto t = std::thread([&] {
+        std::this_thread::sleep_for(20ms);
+        std::string x;
+        chan.read(x);
+    });
+    TEST(chan.write("y"));
+    TRY(t.join());
+    TRY(chan.clear());
+    TEST(chan.empty());
+
+    TRY(chan.close());
+    TEST(chan.wait_for(10ms));
+    TEST(chan.is_closed());
+    TEST(! chan.write("z"));
+
+}
+
+void test_rs_io_channel_bounded_queue_threads() {
+
+    static constexpr int producers = 4;
+    static constexpr int consumers = 4;
+    static constexpr int count = 10'000;
+
+    BoundedQueueChannel<int> chan(64);
+    std::atomic<int64_t> sum(0);
+    std::atomic<int> received(0);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < consumers; ++i) {
+        threads.emplace_back([&] {
+            int x = 0;
+            while (received < producers * count) {
+                if (chan.wait_for(1ms) && chan.read(x)) {
+                    sum += x;
+                    ++received;
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < producers; ++i) {
+        threads.emplace_back([&] {
+            for (int j = 1; j <= count; ++j)
+                chan.write(j);
+        });
+    }
+
+    for (auto& t: threads)
+        TRY(t.join());
+
+    TEST_EQUAL(received.load(), producers * count);
+    TEST_EQUAL(sum.load(), int64_t(producers) * count * (count + 1) / 2);
+
+}
+
+namespace {
+
+    struct Fussy {
+        int value = 0;
+        bool bad = false;
+        Fussy() = default;
+        Fussy(int v, bool b = false): value(v), bad(b) {}
+        Fussy(const Fussy& f): value(f.value), bad(f.bad) { if (bad) throw std::runtime_error("Fussy"); }
+        Fussy& operator=(const Fussy& f) = default;
+    };
+
+}
+
+void test_rs_io_channel_bounded_queue_throwing() {
+
+    BoundedQueueChannel<Fussy> chan(3);
+    Fussy f;
+
+    TEST_THROW(chan.write(Fussy(0, true)), std::runtime_error);
+    TEST(chan.write(Fussy(1)));
+    TEST(chan.read(f));
+    TEST_EQUAL(f.value, 1);
+    TEST(! chan.read(f));
+    TEST(chan.empty());
+
+    for (int i = 2; i < 20; ++i) {
+        TEST_THROW(chan.try_write(Fussy(0, true)), std::runtime_error);
+        TEST(chan.try_write(Fussy(i)));
+        TEST(chan.read(f));
+        TEST_EQUAL(f.value, i);
+        TEST(! chan.read(f));
+    }
+
+    TEST(chan.try_write(Fussy(20)));
+    TEST_THROW(chan.try_write(Fussy(0, true)), std::runtime_error);
+    TEST(chan.try_write(Fussy(21)));
+    TEST(chan.try_write(Fussy(22)));
+    TEST(! chan.try_write(Fussy(23)));
+    auto t = std::thread([&] {
+        std::this_thread::sleep_for(20ms);
+        Fussy x;
+        chan.read(x);
+        chan.read(x);
+        chan.read(x);
+    });
+    TEST(chan.write_for(Fussy(24), 1s));
+    TRY(t.join());
+    TEST(chan.read(f));
+    TEST_EQUAL(f.value, 24);
+    TEST(chan.empty());
+
+}
+
+void test_rs_io_channel_spsc_queue() {
+
+    SpscQueueChannel<std::string> chan(3);
+    std::string s;
+
+    TEST_EQUAL(chan.capacity(), 4u);
+    TEST(chan.empty());
+    TEST(! chan.wait_for(10ms));
+
+    TEST(chan.write("Hello"));
+    TEST_EQUAL(chan.size(), 1u);
+    TEST(chan.wait_for(10ms));
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "Hello");
+    TEST(! chan.wait_for(10ms));
+    TEST(! chan.read(s));
+
+    TEST(chan.try_write("alpha"));
+    TEST(chan.try_write("bravo"));
+    TEST(chan.try_write("charlie"));
+    TEST(chan.try_write("delta"));
+    TEST(! chan.try_write("echo"));
+    TEST_EQUAL(chan.size(), 4u);
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "alpha");
+    TEST(chan.try_write("echo"));
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "bravo");
+    TRY(chan.clear());
+    TEST(chan.empty());
+
+    auto t = std::thread([&] {
+        std::this_thread::sleep_for(20ms);
+        chan.write("foxtrot");
+    });
+    TEST(chan.wait_for(1s));
+    TEST(chan.read(s));
+    TEST_EQUAL(s, "foxtrot");
+    TRY(t.join());
+
+    TRY(chan.close());
+    TEST(chan.wait_for(10ms));
+    TEST(chan.is_closed());
+    TEST(! chan.write("golf"));
+
+}
+
+void test_rs_io_channel_spsc_queue_throughput() {
+
+    static constexpr int count = 1'000'000;
+
+    auto run = [] (auto& chan) {
+        int64_t sum = 0;
+        auto start = steady_clock::now();
+        auto producer = std::thread([&] {
+            for (int i = 1; i <= count; ++i)
+                chan.write(i);
+        });
+        int x = 0;
+        for (int i = 0; i < count; ) {
+            if (chan.wait_for(1s) && chan.read(x)) {
+                sum += x;
+                ++i;
+            }
+        }
+        producer.join();
+        auto time = duration_cast<duration<double>>(steady_clock::now() - start).count();
+        TEST_EQUAL(sum, int64_t(count) * (count + 1) / 2);
+        return int64_t(count / time);
+    };
+
+    QueueChannel<int> queue;
+    BoundedQueueChannel<int> bounded(1024);
+    SpscQueueChannel<int> spsc(1024);
+    int64_t rate = 0;
+
+    TRY(rate = run(queue));
+    std::cout << "... QueueChannel throughput = " << rate << " messages/s" << std::endl;
+    TRY(rate = run(bounded));
+    std::cout << "... BoundedQueueChannel throughput = " << rate << " messages/s" << std::endl;
+    TRY(rate = run(spsc));
+    std::cout << "... SpscQueueChannel throughput = " << rate << " messages/s" << std::endl;
+
+}
+
+void test_rs_io_channel_broadcast() {
+
+    BroadcastChannel<int> chan(4);
+    std::unique_ptr<BroadcastChannel<int>::subscriber> sub1, sub2, sub3;
+    int i = 0;
+
+    TEST_EQUAL(chan.capacity(), 4u);
+    TEST(chan.get_policy() == BroadcastChannel<int>::policy::drop);
+    TEST(chan.write(1));
+    TRY(sub1 = chan.subscribe());
+    TRY(sub2 = chan.subscribe());
+    TEST_EQUAL(chan.subscribers(), 2u);
+    TEST(! sub1->wait_for(10ms));
+
+    TEST(chan.write(2));
+    TEST(chan.write(3));
+    TEST(sub1->wait_for(10ms));
+    TEST_EQUAL(sub1->pending(), 2u);
+    TEST(sub1->read(i));
+    TEST_EQUAL(i, 2);
+    TEST(sub2->read(i));
+    TEST_EQUAL(i, 2);
+    TEST(sub2->read(i));
+    TEST_EQUAL(i, 3);
+    TEST(! sub2->read(i));
+    TEST(! sub2->wait_for(10ms));
+
+    for (int j = 4; j <= 9; ++j)
+        TEST(chan.write(j));
+    TEST_EQUAL(sub1->pending(), 4u);
+    TEST_EQUAL(sub1->dropped(), 3u);
+    TEST_EQUAL(sub2->dropped(), 2u);
+    for (int j = 6; j <= 9; ++j) {
+        TEST(sub1->read(i));
+        TEST_EQUAL(i, j);
+    }
+    TEST(! sub1->read(i));
+    TEST_EQUAL(sub1->dropped(), 3u);
+
+    TRY(sub2->close());
+    TEST(sub2->is_closed());
+    TEST_EQUAL(chan.subscribers(), 1u);
+    TRY(sub3 = chan.subscribe());
+    TEST(chan.write(10));
+    TEST(sub3->read(i));
+    TEST_EQUAL(i, 10);
+    TEST(! sub2->read(i));
+
+    TRY(chan.close());
+    TEST(chan.is_closed());
+    TEST(sub1->is_closed());
+    TEST(sub1->wait_for(10ms));
+    TEST(! sub1->read(i));
+    TEST(! chan.write(11));
+    TRY(sub2 = chan.subscribe());
+    TEST(sub2->is_closed());
+
+}
+
+void test_rs_io_channel_broadcast_block() {
+
+    static constexpr int count = 10'000;
+
+    BroadcastChannel<int> chan(8, BroadcastChannel<int>::policy::block);
+    std::vector<std::unique_ptr<BroadcastChannel<int>::subscriber>> subs;
+    std::vector<std::thread> threads;
+    std::vector<long> sums(3, 0);
+    int i = 0;
+
+    {
+        auto sub = chan.subscribe();
+        for (int j = 0; j < 8; ++j)
+            TEST(chan.try_write(j));
+        TEST(! chan.try_write(8));
+        TEST(sub->read(i));
+        TEST_EQUAL(i, 0);
+        TEST(chan.try_write(8));
+        TEST(! chan.try_write(9));
+    }
+
+    TEST(chan.try_write(9));
+    for (int j = 0; j < 3; ++j)
+        TRY(subs.push_back(chan.subscribe()));
+    for (int j = 0; j < 3; ++j) {
+        threads.emplace_back([&,j] {
+            auto& sub = *subs[j];
+            int n = 0, x = 0;
+            while (n < count && sub.wait_for(1s))
+                while (sub.read(x)) {
+                    sums[j] += x;
+                    ++n;
+                }
+        });
+    }
+    for (int j = 1; j <= count; ++j)
+        TEST(chan.write(j));
+    for (auto& t: threads)
+        TRY(t.join());
+    for (int j = 0; j < 3; ++j) {
+        TEST_EQUAL(sums[j], long(count) * (count + 1) / 2);
+        TEST_EQUAL(subs[j]->dropped(), 0u);
+    }
+
+}
+
+void test_rs_io_channel_broadcast_disconnect() {
+
+    BroadcastChannel<int> chan(4, BroadcastChannel<int>::policy::disconnect);
+    auto fast = chan.subscribe();
+    auto slow = chan.subscribe();
+    int i = 0;
+
+    for (int j = 1; j <= 4; ++j) {
+        TEST(chan.write(j));
+        TEST(fast->read(i));
+        TEST_EQUAL(i, j);
+    }
+    TEST(! slow->is_closed());
+    TEST_EQUAL(slow->pending(), 4u);
+    TEST(chan.write(5));
+    TEST(slow->is_closed());
+    TEST(slow->is_disconnected());
+    TEST(! slow->read(i));
+    TEST(! fast->is_closed());
+    TEST(! fast->is_disconnected());
+    TEST(fast->read(i));
+    TEST_EQUAL(i, 5);
+    TEST_EQUAL(chan.subscribers(), 1u);
+
+}
+
+void test_rs_io_channel_wait_any() {
+
+    QueueChannel<int> queue;
+    TimerChannel timer(50ms);
+    ValueChannel<std::string> value;
+    Channel* cp = nullptr;
+    int i = 0;
+
+    TRY(cp = wait_any({&queue, &value}, 10ms));
+    TEST(! cp);
+
+    TRY(queue.write(42));
+    TRY(cp = wait_any({&queue, &timer}, 10ms));
+    TEST_EQUAL(cp, &queue);
+    TEST(queue.read(i));
+    TEST_EQUAL(i, 42);
+
+    auto start = Channel::clock::now();
+    TRY(cp = wait_any({&queue, &timer}, 1s));
+    auto elapsed = Channel::clock::now() - start;
+    TEST_EQUAL(cp, &timer);
+    TEST(elapsed >= 30ms);
+    TEST(elapsed <= 500ms);
+    TRY(timer.flush());
+
+    auto t = std::thread([&] {
+        std::this_thread::sleep_for(20ms);
+        value.write("hello");
+    });
+    TRY(cp = wait_any(std::vector<Channel*>{&queue, &value}, 1s));
+    TRY(t.join());
+    TEST_EQUAL(cp, &value);
+
+    TRY(queue.close());
+    TRY(cp = wait_any({&queue, &timer}));
+    TEST_EQUAL(cp, &queue);
+
+    TEST_THROW(wait_any({&timer, &timer}, 1ms), std::invalid_argument);
+    TRY(cp = wait_any({&timer}, 1s));
+    TEST_EQUAL(cp, &timer);
+
+}
+
+void test_rs_io_channel_wait_any_latency() {
+
+    static constexpr int count = 10'000;
+
+    QueueChannel<int> ping, pong;
+    TimerChannel timer1(1h), timer2(1h);
+    std::atomic<bool> ok(true);
+
+    auto t = std::thread([&] {
+        int i = 0;
+        for (int j = 0; j < count; ++j) {
+            if (wait_any({&ping, &timer1}, 1s) != &ping || ! ping.read(i))
+                ok = false;
+            pong.write(i);
+        }
+    });
+
+    auto start = Channel::clock::now();
+    int i = 0;
+    for (int j = 0; j < count; ++j) {
+        TRY(ping.write(j));
+        REQUIRE(wait_any({&pong, &timer2}, 1s) == &pong);
+        TEST(pong.read(i));
+    }
+    auto stop = Channel::clock::now();
+    TRY(t.join());
+    TEST(ok);
+    TEST_EQUAL(i, count - 1);
+
+    double ns = duration<double, std::nano>(stop - start).count() / count;
+    std::cout << "... wait_any() round trip = " << int(ns) << " ns" << std::endl;
+
+}
@@ -1,10 +1,14 @@
 #include "rs-io/channel.hpp"
+#include "rs-io/thread-pool.hpp"
 #include "rs-unit-test.hpp"
 #include <atomic>
 #include <chrono>
 #include <exception>
+#include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace RS::IO;
@@ -23,6 +27,32 @@ namespace {
         bool is_synchronous() const noexcept override { return true; }
     };
 
+    class SyncQueueChannel:
+    public QueueChannel<int64_t> {
+    public:
+        bool is_synchronous() const noexcept override { return true; }
+    };
+
+    int64_t dispatch_latency(Dispatch& disp, QueueChannel<int64_t>& chan) {
+        static constexpr int iterations = 200;
+        int64_t total = 0;
+        int n = 0;
+        disp.add(chan, [&] (int64_t t) {
+            total += duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() - t;
+            if (++n == iterations)
+                chan.close();
+        });
+        auto writer = std::thread([&] {
+            for (int i = 0; i < iterations; ++i) {
+                std::this_thread::sleep_for(200us);
+                chan.write(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+            }
+        });
+        disp.run();
+        writer.join();
+        return total / iterations / 1000;
+    }
+
 }
 
 void test_rs_io_channel_dispatch_empty() {
@@ -244,3 +274,527 @@ void test_rs_io_channel_dispatch_async_stream_channel() {
     TRY(disp.stop());
 
 }
+
+void test_rs_io_channel_dispatch_reactor_message_channel() {
+
+    QueueChannel<int> chan;
+    Dispatch disp(Dispatch::mode::reactor);
+    Dispatch::result rc;
+    std::string s;
+    std::vector<int> v;
+    for (int i = 1; i <= 5; ++i)
+        TRY(chan.write(i));
+    TRY(disp.add(chan, [&] (int i) {
+        v.push_back(i);
+        if (i >= 30)
+            chan.close();
+    }));
+    auto t = std::thread([&] {
+        for (int i = 6; i <= 30; ++i) {
+            chan.write(i);
+            if (i % 10 == 0)
+                std::this_thread::sleep_for(5ms);
+        }
+    });
+    TRY(rc = disp.run());
+    TRY(t.join());
+    TEST_EQUAL(rc.channel, &chan);
+    TEST(! rc.error);
+    TEST(chan.is_closed());
+    TEST_EQUAL(v.size(), 30u);
+    TEST_EQUAL(v.front(), 1);
+    TEST_EQUAL(v.back(), 30);
+    TRY(disp.stop());
+
+}
+
+void test_rs_io_channel_dispatch_reactor_stream_channel() {
+
+    BufferChannel chan;
+    Dispatch disp(Dispatch::mode::reactor);
+    Dispatch::result rc;
+    std::string s;
+    TRY(chan.set_block_size(5));
+    TRY(disp.add(chan, [&] (std::string& t) {
+        s += t;
+        t.clear();
+        if (s.find('\n') != std::string::npos)
+            chan.close();
+    }));
+    auto t = std::thread([&] {
+        std::this_thread::sleep_for(10ms);
+        chan.write("Hello ");
+        std::this_thread::sleep_for(10ms);
+        chan.write("world\n");
+    });
+    TRY(rc = disp.run());
+    TRY(t.join());
+    TEST_EQUAL(rc.channel, &chan);
+    TEST(! rc.error);
+    TEST(chan.is_closed());
+    TEST_EQUAL(s, "Hello world\n");
+    TRY(disp.stop());
+
+}
+
+void test_rs_io_channel_dispatch_reactor_heterogeneous() {
+
+    SyncTimerChannel chan1(time_interval);
+    TimerChannel chan2(time_interval);
+    QueueChannel<int> chan3;
+    Dispatch disp(Dispatch::mode::reactor);
+    Dispatch::result rc;
+    std::atomic<int> n1(0), n2(0), n3(0);
+    {
+        TRY(disp.add(chan1, [&] { ++n1; }));
+        TRY(disp.add(chan2, [&] { ++n2; }));
+        TRY(disp.add(chan3, [&] (int i) { n3 += i; if (n3 >= cycles) throw std::runtime_error("Test"); }));
+        for (int i = 0; i < cycles; ++i)
+            TRY(chan3.write(1));
+        TRY(rc = disp.run());
+        TEST_EQUAL(rc.channel, &chan3);
+        TEST(rc.error);
+        TEST_THROW(std::rethrow_exception(rc.error), std::runtime_error);
+        TEST_EQUAL(n3.load(), cycles);
+        TRY(disp.stop());
+    }
+    TEST(chan1.is_closed());
+    TEST(chan2.is_closed());
+    TEST(chan3.is_closed());
+    TEST(disp.empty());
+
+}
+
+void test_rs_io_channel_dispatch_reactor_stop() {
+
+    QueueChannel<int> chan1;
+    ValueChannel<int> chan2;
+    Dispatch disp(Dispatch::mode::reactor);
+    int n = 0;
+    TRY(disp.add(chan1, [&] (int) { ++n; }));
+    TRY(disp.add(chan2, [&] (int) { ++n; }));
+    auto t = std::thread([&] {
+        std::this_thread::sleep_for(10ms);
+        chan1.close();
+        std::this_thread::sleep_for(10ms);
+        chan2.close();
+    });
+    TRY(disp.run());
+    TRY(disp.run());
+    TRY(t.join());
+    TEST(disp.empty());
+    TEST_EQUAL(n, 0);
+    TRY(disp.stop());
+
+}
+
+void test_rs_io_channel_dispatch_bounded_queue() {
+
+    for (auto m: {Dispatch::mode::threads, Dispatch::mode::reactor}) {
+        BoundedQueueChannel<int> chan(8);
+        Dispatch disp(m);
+        Dispatch::result rc;
+        int sum = 0;
+        TRY(disp.add(chan, [&] (int i) {
+            sum += i;
+            if (i == 100)
+                chan.close();
+        }));
+        auto t = std::thread([&] {
+            for (int i = 1; i <= 100; ++i)
+                chan.write(i);
+        });
+        TRY(rc = disp.run());
+        TRY(t.join());
+        TEST_EQUAL(rc.channel, &chan);
+        TEST(! rc.error);
+        TEST_EQUAL(sum, 5050);
+        TRY(disp.stop());
+    }
+
+}
+
+void test_rs_io_channel_dispatch_notify_lifetime() {
+
+    // Destroy the dispatch while a producer may still be inside notify()
+
+    static constexpr int iterations = 200;
+
+    for (int i = 0; i < iterations; ++i) {
+        BoundedQueueChannel<int> chan(64);
+        std::thread producer;
+        {
+            Dispatch disp(Dispatch::mode::reactor);
+            Dispatch::result rc;
+            TRY(disp.add(chan, [&] (int) { chan.close(); }));
+            producer = std::thread([&] {
+                for (int j = 0; ! chan.is_closed(); ++j)
+                    chan.try_write(j);
+            });
+            TRY(rc = disp.run());
+            TEST_EQUAL(rc.channel, &chan);
+            TEST(! rc.error);
+        }
+        producer.join();
+    }
+
+}
+
+void test_rs_io_channel_dispatch_spsc_queue() {
+
+    for (auto m: {Dispatch::mode::threads, Dispatch::mode::reactor}) {
+        SpscQueueChannel<int> chan(8);
+        Dispatch disp(m);
+        Dispatch::result rc;
+        int sum = 0;
+        TRY(disp.add(chan, [&] (int i) {
+            sum += i;
+            if (i == 100)
+                chan.close();
+        }));
+        auto t = std::thread([&] {
+            for (int i = 1; i <= 100; ++i)
+                chan.write(i);
+        });
+        TRY(rc = disp.run());
+        TRY(t.join());
+        TEST_EQUAL(rc.channel, &chan);
+        TEST(! rc.error);
+        TEST_EQUAL(sum, 5050);
+        TRY(disp.stop());
+    }
+
+}
+
+void test_rs_io_channel_dispatch_broadcast() {
+
+    for (auto m: {Dispatch::mode::threads, Dispatch::mode::reactor}) {
+        BroadcastChannel<int> chan(8, BroadcastChannel<int>::policy::block);
+        std::vector<std::unique_ptr<BroadcastChannel<int>::subscriber>> subs;
+        std::vector<int> sums(3, 0);
+        Dispatch disp(m);
+        Dispatch::result rc;
+        for (int j = 0; j < 3; ++j) {
+            TRY(subs.push_back(chan.subscribe()));
+            TRY(disp.add(*subs[j], [&,j] (int i) {
+                sums[j] += i;
+                if (i == 100)
+                    subs[j]->close();
+            }));
+        }
+        auto t = std::thread([&] {
+            for (int i = 1; i <= 100; ++i)
+                chan.write(i);
+        });
+        for (int j = 0; j < 3 && ! disp.empty(); ++j) {
+            TRY(rc = disp.run());
+            TEST(rc.is_closed());
+        }
+        TRY(t.join());
+        TEST(disp.empty());
+        for (int j = 0; j < 3; ++j)
+            TEST_EQUAL(sums[j], 5050);
+        TRY(disp.stop());
+    }
+
+}
+
+void test_rs_io_channel_dispatch_timer_wheel() {
+
+    static constexpr int count = 1000;
+
+    for (auto m: {Dispatch::mode::threads, Dispatch::mode::reactor}) {
+        Dispatch disp(m);
+        std::vector<std::unique_ptr<TimerChannel>> timers;
+        Dispatch::result rc;
+        int ticks = 0;
+        for (int i = 0; i < count; ++i) {
+            TRY(timers.push_back(std::make_unique<TimerChannel>(disp.timers(), milliseconds(1 + i % 10), 4)));
+            TEST_EQUAL(timers.back()->wheel(), &disp.timers());
+            TRY(disp.add(*timers.back(), [&] { ++ticks; }));
+        }
+        TEST_EQUAL(disp.timers().size(), size_t(count));
+        auto t0 = system_clock::now();
+        for (int i = 0; i < count && ! disp.empty(); ++i) {
+            TRY(rc = disp.run());
+            TEST(rc.is_closed());
+        }
+        auto t1 = system_clock::now();
+        TEST(disp.empty());
+        TEST_EQUAL(ticks, 3 * count); // The last tick closes the channel
+        TEST(disp.timers().empty());
+        TEST(t1 - t0 < 1s);
+    }
+
+}
+
+void test_rs_io_channel_dispatch_pool_serial() {
+
+    static constexpr int count = 1000;
+
+    ThreadPool pool(4);
+
+    for (auto m: {Dispatch::mode::threads, Dispatch::mode::reactor}) {
+        QueueChannel<int> chan;
+        Dispatch disp(m);
+        Dispatch::result rc;
+        std::vector<int> seen;
+        TRY(disp.add(chan, pool, [&] (int i) {
+            seen.push_back(i);
+            if (i == count)
+                chan.close();
+        }));
+        for (int i = 1; i <= count; ++i)
+            TRY(chan.write(i));
+        TRY(rc = disp.run());
+        TEST_EQUAL(rc.channel, &chan);
+        TEST(! rc.error);
+        TEST_EQUAL(int(seen.size()), count);
+        bool ordered = true;
+        for (int i = 0; i < int(seen.size()); ++i)
+            ordered &= seen[i] == i + 1;
+        TEST(ordered);
+    }
+
+}
+
+void test_rs_io_channel_dispatch_pool_concurrent() {
+
+    static constexpr int count = 8;
+
+    ThreadPool pool(count);
+
+    for (auto m: {Dispatch::mode::threads, Dispatch::mode::reactor}) {
+        QueueChannel<int> chan;
+        Dispatch disp(m);
+        Dispatch::result rc;
+        std::atomic<int> sum(0), calls(0);
+        TRY(disp.add(chan, pool, [&] (int i) {
+            std::this_thread::sleep_for(50ms);
+            sum += i;
+            if (++calls == count)
+                chan.close();
+        }, Dispatch::order::concurrent));
+        auto t0 = system_clock::now();
+        for (int i = 1; i <= count; ++i)
+            TRY(chan.write(i));
+        TRY(rc = disp.run());
+        auto t1 = system_clock::now();
+        TEST_EQUAL(rc.channel, &chan);
+        TEST(! rc.error);
+        TEST_EQUAL(sum, count * (count + 1) / 2);
+        TEST(t1 - t0 < count * 50ms);
+    }
+
+}
+
+void test_rs_io_channel_dispatch_pool_exception() {
+
+    ThreadPool pool(2);
+    QueueChannel<int> chan;
+    TimerChannel timer(5ms);
+    BufferChannel buf;
+    Dispatch disp;
+    Dispatch::result rc;
+    std::string text;
+
+    TRY(disp.add(chan, pool, [&] (int i) {
+        if (i == 3)
+            throw std::runtime_error("Bad message");
+    }));
+    TRY(disp.add(buf, pool, [&] (std::string& s) {
+        text += s;
+        s.clear();
+    }));
+    TRY(buf.write("Hello "));
+    TRY(buf.write("world"));
+    for (int i = 1; i <= 5; ++i)
+        TRY(chan.write(i));
+    TRY(rc = disp.run());
+    TEST_EQUAL(rc.channel, &chan);
+    TEST_THROW(std::rethrow_exception(rc.error), std::runtime_error);
+
+    TRY(disp.add(timer, pool, [&] { buf.close(); }));
+    TRY(rc = disp.run());
+    TEST_EQUAL(rc.channel, &buf);
+    TEST(! rc.error);
+    TEST_EQUAL(text, "Hello world");
+    TRY(disp.stop());
+
+}
+
+void test_rs_io_channel_dispatch_pool_clear() {
+
+    ThreadPool pool(1);
+
+    for (auto o: {Dispatch::order::serial, Dispatch::order::concurrent}) {
+
+        QueueChannel<int> chan;
+        Dispatch disp(Dispatch::mode::threads);
+        Dispatch::result rc;
+        std::atomic<bool> blocked(false), release(false);
+        std::atomic<int> calls(0);
+
+        // Block the only worker so the handler job is still queued
+        TRY(pool.insert([&] {
+            blocked = true;
+            while (! release)
+                std::this_thread::sleep_for(1ms);
+        }));
+        while (! blocked)
+            std::this_thread::sleep_for(1ms);
+        TRY(disp.add(chan, pool, [&] (int) { ++calls; }, o));
+        TRY(chan.write(1));
+        std::this_thread::sleep_for(20ms);
+        std::thread releaser([&] {
+            std::this_thread::sleep_for(50ms);
+            release = true;
+        });
+        TRY(pool.clear());
+        releaser.join();
+        TEST_EQUAL(calls.load(), 0);
+
+        // The discarded job must not leave the channel looking busy
+        TRY(chan.close());
+        TRY(rc = disp.run());
+        TEST_EQUAL(rc.channel, &chan);
+        TEST(! rc.error);
+        TEST(disp.empty());
+        TRY(disp.stop());
+
+    }
+
+}
+
+void test_rs_io_channel_dispatch_strand() {
+
+    static constexpr int count = 1000;
+
+    ThreadPool pool(4);
+    Strand strand(pool);
+
+    for (auto m: {Dispatch::mode::threads, Dispatch::mode::reactor}) {
+        QueueChannel<int> chan1, chan2;
+        Dispatch disp(m);
+        Dispatch::result rc;
+        std::vector<int> seen1, seen2;
+        std::atomic<int> inside(0), overlaps(0);
+        auto handler = [&] (std::vector<int>& seen, QueueChannel<int>& chan) {
+            return [&] (int i) {
+                if (++inside > 1)
+                    ++overlaps;
+                seen.push_back(i);
+                if (i == count)
+                    chan.close();
+                --inside;
+            };
+        };
+        TRY(disp.add(chan1, strand, handler(seen1, chan1)));
+        TRY(disp.add(chan2, strand, handler(seen2, chan2)));
+        for (int i = 1; i <= count; ++i) {
+            TRY(chan1.write(i));
+            TRY(chan2.write(i));
+        }
+        for (int i = 0; i < 2; ++i) {
+            TRY(rc = disp.run());
+            TEST(! rc.error);
+        }
+        TEST(disp.empty());
+        TEST_EQUAL(overlaps.load(), 0);
+        TEST_EQUAL(int(seen1.size()), count);
+        TEST_EQUAL(int(seen2.size()), count);
+        bool ordered = true;
+        for (int i = 0; i < count; ++i)
+            ordered &= seen1[i] == i + 1 && seen2[i] == i + 1;
+        TEST(ordered);
+    }
+
+}
+
+void test_rs_io_channel_dispatch_strand_drop() {
+
+    // Drop each channel from inside its last job, so the executor is
+    // released while the job is still finishing
+
+    static constexpr int iterations = 200;
+
+    ThreadPool pool(4);
+    Strand strand(pool);
+    int calls = 0;
+
+    for (int i = 0; i < iterations; ++i) {
+        auto m = i % 2 == 0 ? Dispatch::mode::threads : Dispatch::mode::reactor;
+        QueueChannel<int> chan1, chan2;
+        Dispatch disp(m);
+        Dispatch::result rc;
+        TRY(disp.add(chan1, pool, [&] (int) { ++calls; chan1.close(); }, Dispatch::order::serial));
+        TRY(disp.add(chan2, strand, [&] (int) { ++calls; chan2.close(); }));
+        TRY(chan1.write(i));
+        TRY(chan2.write(i));
+        for (int j = 0; j < 2; ++j) {
+            TRY(rc = disp.run());
+            TEST(! rc.error);
+        }
+        TEST(disp.empty());
+    }
+
+    TEST_EQUAL(calls, 2 * iterations);
+
+}
+
+void test_rs_io_channel_dispatch_batch() {
+
+    for (auto m: {Dispatch::mode::threads, Dispatch::mode::reactor}) {
+        QueueChannel<int> chan;
+        Dispatch disp(m);
+        Dispatch::result rc;
+        std::vector<int> v;
+        size_t batches = 0;
+        TRY(chan.write_batch(std::vector<int>{1, 2, 3, 4, 5}));
+        TRY(disp.add(chan, [&] (std::vector<int>& batch) {
+            ++batches;
+            v.insert(v.end(), batch.begin(), batch.end());
+            if (v.size() >= 10)
+                chan.close();
+        }));
+        auto t = std::thread([&] {
+            std::this_thread::sleep_for(10ms);
+            chan.write_batch(std::vector<int>{6, 7, 8, 9, 10});
+        });
+        TRY(rc = disp.run());
+        TRY(t.join());
+        TEST_EQUAL(rc.channel, &chan);
+        TEST(! rc.error);
+        TEST_EQUAL(RS::UnitTest::format_range(v), "[1,2,3,4,5,6,7,8,9,10]");
+        TEST_EQUAL(batches, 2u);
+        TRY(disp.stop());
+    }
+
+}
+
+void test_rs_io_channel_dispatch_latency() {
+
+    int64_t us = 0;
+
+    {
+        SyncQueueChannel chan;
+        Dispatch disp;
+        TRY(us = dispatch_latency(disp, chan));
+        std::cout << "... Mean dispatch latency (synchronous) = " << us << " us" << std::endl;
+    }
+
+    {
+        QueueChannel<int64_t> chan;
+        Dispatch disp;
+        TRY(us = dispatch_latency(disp, chan));
+        std::cout << "... Mean dispatch latency (thread) = " << us << " us" << std::endl;
+    }
+
+    {
+        QueueChannel<int64_t> chan;
+        Dispatch disp(Dispatch::mode::reactor);
+        TRY(us = dispatch_latency(disp, chan));
+        std::cout << "... Mean dispatch latency (reactor) = " << us << " us" << std::endl;
+    }
+
+}
@@ -0,0 +1,245 @@
+#include "rs-io/coroutine.hpp"
+#include "rs-io/channel.hpp"
+#include "rs-io/net.hpp"
+#include "rs-io/thread-pool.hpp"
+#include "rs-unit-test.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace RS::IO;
+using namespace std::chrono;
+
+#ifdef RS_IO_COROUTINES
+
+    namespace {
+
+        Task<int> answer() {
+            co_return 42;
+        }
+
+        Task<int> add_one(Task<int> t) {
+            int x = co_await t;
+            co_return x + 1;
+        }
+
+        Task<void> fail() {
+            throw std::runtime_error("fail");
+            co_return;
+        }
+
+        Task<bool> check_pool(ThreadPool& pool) {
+            bool before = ThreadPool::current() == &pool;
+            co_await schedule_on(pool);
+            bool after = ThreadPool::current() == &pool;
+            co_return ! before && after;
+        }
+
+        Task<int> sum_queue(QueueChannel<int>& chan) {
+            int sum = 0;
+            for (;;) {
+                auto x = co_await chan.async_read();
+                if (! x)
+                    break;
+                sum += *x;
+            }
+            co_return sum;
+        }
+
+        Task<std::string> read_buffer(StreamChannel& chan) {
+            std::string s;
+            while (co_await chan.async_read(s) > 0) {}
+            co_return s;
+        }
+
+        Task<int> count_ticks(TimerChannel& chan, int limit) {
+            int n = 0;
+            while (co_await chan.async_read())
+                if (++n == limit)
+                    chan.close();
+            co_return n;
+        }
+
+        Task<int> hold(std::shared_ptr<int> p) {
+            co_return *p;
+        }
+
+        Task<int64_t> total_latency(QueueChannel<int64_t>& chan) {
+            int64_t total = 0;
+            for (;;) {
+                auto x = co_await chan.async_read();
+                if (! x)
+                    break;
+                auto now = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+                total += now - *x;
+            }
+            co_return total;
+        }
+
+    }
+
+#endif
+
+void test_rs_io_coroutine_task() {
+
+    #ifdef RS_IO_COROUTINES
+
+        ThreadPool pool(2);
+        Future<int> fi;
+        Future<void> fv;
+        Future<bool> fb;
+
+        TRY(fi = spawn(pool, answer()));
+        TEST_EQUAL(fi.get(), 42);
+        TRY(fi = spawn(pool, add_one(answer())));
+        TEST_EQUAL(fi.get(), 43);
+        TRY(fv = spawn(pool, fail()));
+        TEST_THROW(fv.get(), std::runtime_error);
+
+        ThreadPool other(1);
+        TRY(fb = spawn(other, check_pool(pool)));
+        TEST(fb.get());
+
+    #endif
+
+}
+
+void test_rs_io_coroutine_spawn_discarded() {
+
+    #ifdef RS_IO_COROUTINES
+
+        ThreadPool pool(1);
+        std::atomic<bool> busy(false), release(false);
+        auto ptr = std::make_shared<int>(42);
+        Future<int> fi;
+
+        TRY(pool.insert([&] { busy = true; while (! release) std::this_thread::sleep_for(1ms); }));
+        while (! busy)
+            std::this_thread::sleep_for(1ms);
+        TRY(fi = spawn(pool, hold(ptr)));
+        TEST_EQUAL(ptr.use_count(), 2);
+
+        auto t = std::thread([&pool] { pool.clear(); });
+        TEST(fi.wait_for(1s));
+        TEST_EQUAL(ptr.use_count(), 1);
+        TEST_THROW(fi.get(), std::future_error);
+        release = true;
+        TRY(t.join());
+
+        TRY(fi = spawn(pool, hold(ptr)));
+        TEST_EQUAL(fi.get(), 42);
+
+    #endif
+
+}
+
+void test_rs_io_coroutine_channels() {
+
+    #ifdef RS_IO_COROUTINES
+
+        ThreadPool pool(2);
+
+        {
+            QueueChannel<int> chan;
+            Future<int> fi;
+            TRY(fi = spawn(pool, sum_queue(chan)));
+            for (int i = 1; i <= 10; ++i) {
+                TRY(chan.write(i));
+                std::this_thread::sleep_for(2ms);
+            }
+            std::this_thread::sleep_for(10ms);
+            TRY(chan.close());
+            TEST(fi.wait_for(2s));
+            TEST_EQUAL(fi.get(), 55);
+        }
+
+        {
+            BufferChannel chan;
+            Future<std::string> fs;
+            TRY(fs = spawn(pool, read_buffer(chan)));
+            TRY(chan.write("Hello "));
+            std::this_thread::sleep_for(10ms);
+            TRY(chan.write("world"));
+            std::this_thread::sleep_for(10ms);
+            TRY(chan.close());
+            TEST(fs.wait_for(2s));
+            TEST_EQUAL(fs.get(), "Hello world");
+        }
+
+        {
+            TimerChannel chan(5ms);
+            Future<int> fi;
+            TRY(fi = spawn(pool, count_ticks(chan, 5)));
+            TEST(fi.wait_for(2s));
+            TEST_EQUAL(fi.get(), 5);
+        }
+
+    #endif
+
+}
+
+void test_rs_io_coroutine_native_handle() {
+
+    #ifdef RS_IO_COROUTINES
+
+        static constexpr uint16_t port = 14883;
+
+        ThreadPool pool(1);
+        std::unique_ptr<TcpServer> server;
+        std::unique_ptr<TcpClient> local, remote;
+        Future<std::string> fs;
+
+        TRY(server = std::make_unique<TcpServer>(IPv4(), port));
+        TRY(remote = std::make_unique<TcpClient>(IPv4::localhost(), port));
+        TEST(server->wait_for(500ms));
+        TEST(server->read(local));
+        REQUIRE(local);
+
+        TRY(fs = spawn(pool, read_buffer(*local)));
+        std::this_thread::sleep_for(10ms);
+        TEST(remote->write("Hello "));
+        std::this_thread::sleep_for(10ms);
+        TEST(remote->write("world"));
+        std::this_thread::sleep_for(10ms);
+        TRY(remote.reset());
+        TEST(fs.wait_for(2s));
+        TEST_EQUAL(fs.get(), "Hello world");
+
+    #endif
+
+}
+
+void test_rs_io_coroutine_latency() {
+
+    #ifdef RS_IO_COROUTINES
+
+        static constexpr int iterations = 100;
+
+        // Writes are spaced out so a polling reader would have backed off
+
+        ThreadPool pool(1);
+        QueueChannel<int64_t> chan;
+        Future<int64_t> fi;
+        TRY(fi = spawn(pool, total_latency(chan)));
+        for (int i = 0; i < iterations; ++i) {
+            std::this_thread::sleep_for(5ms);
+            TRY(chan.write(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count()));
+        }
+        std::this_thread::sleep_for(10ms);
+        TRY(chan.close());
+        TEST(fi.wait_for(2s));
+        int64_t total = 0;
+        TRY(total = fi.get());
+        auto mean = total / iterations / 1000;
+        std::cout << "... Mean async read latency = " << mean << " us" << std::endl;
+        TEST(mean < 500);
+
+    #endif
+
+}
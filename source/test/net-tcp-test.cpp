@@ -3,11 +3,18 @@
 #include "rs-unit-test.hpp"
 #include <algorithm>
 #include <chrono>
+#include <iostream>
 #include <memory>
 #include <string>
 #include <thread>
 #include <vector>
 
+#ifdef _XOPEN_SOURCE
+    #include <sys/resource.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
 using namespace RS::IO;
 using namespace std::chrono;
 using namespace std::literals;
@@ -126,3 +133,251 @@ void test_rs_io_net_socket_set() {
     TRY(t3.join());
 
 }
+
+void test_rs_io_net_socket_set_many() {
+
+    #ifdef _XOPEN_SOURCE
+
+        // Enough sockets that the descriptors go past FD_SETSIZE
+
+        static constexpr int count = 800;
+        static constexpr int rounds = 10'000;
+
+        rlimit limit;
+        REQUIRE(::getrlimit(RLIMIT_NOFILE, &limit) == 0);
+        if (limit.rlim_cur < 4 * count) {
+            limit.rlim_cur = std::min(rlim_t(4 * count), limit.rlim_max);
+            ::setrlimit(RLIMIT_NOFILE, &limit);
+            ::getrlimit(RLIMIT_NOFILE, &limit);
+            if (limit.rlim_cur < 4 * count) {
+                std::cout << "... Skipped: not enough file descriptors" << std::endl;
+                return;
+            }
+        }
+
+        std::vector<std::unique_ptr<Socket>> sockets;
+        std::vector<int> remotes;
+        SocketSet set;
+        Channel* cp = nullptr;
+        std::string msg;
+        int max_fd = 0;
+
+        for (int i = 0; i < count; ++i) {
+            int fds[2];
+            REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+            sockets.push_back(std::make_unique<Socket>(fds[0]));
+            remotes.push_back(fds[1]);
+            max_fd = std::max(max_fd, fds[0]);
+            TRY(set.insert(*sockets.back()));
+        }
+        TEST(max_fd >= 1024);
+        TEST_EQUAL(set.size(), size_t(count));
+        TEST(! set.wait_for(10ms));
+
+        for (int i: {0, count / 2, count - 1}) {
+            REQUIRE(::write(remotes[i], "hello", 5) == 5);
+            TEST(set.wait_for(100ms));
+            TEST(set.read(cp));
+            TEST_EQUAL(cp, sockets[i].get());
+            msg.clear();
+            TEST(sockets[i]->append(msg));
+            TEST_EQUAL(msg, "hello");
+            TEST(! sockets[i]->poll());
+            TEST(! set.poll());
+        }
+
+        TRY(set.erase(*sockets[count - 1]));
+        TEST_EQUAL(set.size(), size_t(count - 1));
+        REQUIRE(::write(remotes[count - 1], "hello", 5) == 5);
+        TEST(! set.wait_for(10ms));
+        TEST(sockets[count - 1]->wait_for(10ms));
+
+        char c = 0;
+        auto start = Channel::clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            int i = r * 7919 % (count - 1);
+            [[maybe_unused]] auto rc = ::write(remotes[i], "x", 1);
+            if (! set.wait_for(1s) || ! set.read(cp) || cp != sockets[i].get() || sockets[i]->read(&c, 1) != 1)
+                break;
+        }
+        auto stop = Channel::clock::now();
+        TEST_EQUAL(c, 'x');
+        double ns = duration<double, std::nano>(stop - start).count() / rounds;
+        std::cout << "... SocketSet wait/read with " << count << " sockets = " << int(ns) << " ns" << std::endl;
+
+        for (int fd: remotes)
+            ::close(fd);
+
+    #endif
+
+}
+
+void test_rs_io_net_socket_set_events() {
+
+    #ifdef _XOPEN_SOURCE
+
+        static constexpr int count = 8;
+
+        using flag = SocketSet::flag;
+
+        std::vector<std::unique_ptr<Socket>> sockets;
+        std::vector<int> remotes;
+        std::vector<SocketSet::event> events;
+        std::vector<int> hits(count, 0);
+        SocketSet set;
+        Channel* cp = nullptr;
+        size_t n = 0;
+
+        for (int i = 0; i < count; ++i) {
+            int fds[2];
+            REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+            sockets.push_back(std::make_unique<Socket>(fds[0]));
+            remotes.push_back(fds[1]);
+            TRY(set.insert(*sockets.back()));
+        }
+        auto index_of = [&] (Channel* c) {
+            for (int i = 0; i < count; ++i)
+                if (sockets[i].get() == c)
+                    return i;
+            return -1;
+        };
+
+        TRY(n = set.wait_events(events, 10ms));
+        TEST_EQUAL(n, 0u);
+        TEST(events.empty());
+
+        // Every ready socket arrives in one batch
+        for (int fd: remotes)
+            REQUIRE(::write(fd, "x", 1) == 1);
+        TRY(n = set.wait_events(events, 100ms));
+        TEST_EQUAL(n, size_t(count));
+        for (auto& ev: events) {
+            int i = index_of(ev.channel);
+            REQUIRE(i >= 0);
+            ++hits[i];
+            TEST(ev.flags == flag::readable);
+        }
+        TEST(std::all_of(hits.begin(), hits.end(), [] (int h) { return h == 1; }));
+
+        // Sockets that stay ready are all served in turn
+        std::fill(hits.begin(), hits.end(), 0);
+        for (int r = 0; r < 3 * count; ++r) {
+            TEST(set.read(cp));
+            int i = index_of(cp);
+            REQUIRE(i >= 0);
+            ++hits[i];
+        }
+        TEST(std::all_of(hits.begin(), hits.end(), [] (int h) { return h == 3; }));
+
+        char c = 0;
+        for (auto& sock: sockets)
+            TEST_EQUAL(sock->read(&c, 1), 1u);
+        TEST(! set.wait_for(10ms));
+
+        TRY(set.modify(*sockets[0], flag::readable | flag::writable));
+        TRY(n = set.wait_events(events, 100ms));
+        TEST_EQUAL(n, 1u);
+        REQUIRE(n == 1);
+        TEST_EQUAL(events[0].channel, sockets[0].get());
+        TEST(events[0].flags == flag::writable);
+        TEST(! set.poll());
+        TRY(set.modify(*sockets[0], flag::readable));
+
+        ::close(remotes[1]);
+        remotes[1] = -1;
+        TRY(n = set.wait_events(events, 100ms));
+        TEST_EQUAL(n, 1u);
+        REQUIRE(n == 1);
+        TEST_EQUAL(events[0].channel, sockets[1].get());
+        TEST(!! (events[0].flags & flag::hangup));
+        TEST(set.read(cp));
+        TEST_EQUAL(cp, sockets[1].get());
+        TEST_EQUAL(sockets[1]->read(&c, 1), 0u);
+        TEST(sockets[1]->is_closed());
+        TRY(set.erase(*sockets[1]));
+        TEST_EQUAL(set.size(), size_t(count - 1));
+
+        for (int fd: remotes)
+            if (fd != -1)
+                ::close(fd);
+
+    #endif
+
+}
+
+void test_rs_io_net_tcp_dispatch() {
+
+    std::unique_ptr<TcpServer> server;
+    std::unique_ptr<TcpClient> client;
+    Dispatch disp(Dispatch::mode::reactor);
+    Dispatch::result rc;
+    std::string msg;
+
+    auto t = std::thread([] {
+        std::unique_ptr<TcpClient> client;
+        std::this_thread::sleep_for(50ms);
+        TRY(client = std::make_unique<TcpClient>(IPv4::localhost(), port));
+        TRY(client->write("hello"));
+        std::this_thread::sleep_for(50ms);
+        TRY(client->write(" world"));
+        std::this_thread::sleep_for(50ms);
+    });
+
+    TRY(server = std::make_unique<TcpServer>(IPv4(), port));
+    TEST(server->wait_for(500ms));
+    TEST(server->read(client));
+    REQUIRE(client);
+    TRY(disp.add(*client, [&] (std::string& s) {
+        msg += s;
+        s.clear();
+    }));
+    TRY(rc = disp.run());
+    TRY(t.join());
+    TEST_EQUAL(rc.channel, client.get());
+    TEST(! rc.error);
+    TEST_EQUAL(msg, "hello world");
+    TRY(disp.stop());
+
+}
+
+void test_rs_io_net_tcp_wait_any() {
+
+    std::unique_ptr<TcpServer> server;
+    std::unique_ptr<TcpClient> client;
+    QueueChannel<int> queue;
+    Channel* cp = nullptr;
+    std::string msg;
+    int i = 0;
+
+    TRY(server = std::make_unique<TcpServer>(IPv4(), port));
+    auto t = std::thread([&] {
+        TcpClient remote(IPv4::localhost(), port);
+        std::this_thread::sleep_for(50ms);
+        queue.write(42);
+        std::this_thread::sleep_for(50ms);
+        remote.write("hello");
+        std::this_thread::sleep_for(50ms);
+    });
+
+    TRY(cp = wait_any({server.get(), &queue}, 1s));
+    TEST_EQUAL(cp, server.get());
+    TEST(server->read(client));
+    REQUIRE(client);
+
+    TRY(cp = wait_any({client.get(), &queue}, 1s));
+    TEST_EQUAL(cp, &queue);
+    TEST(queue.read(i));
+    TEST_EQUAL(i, 42);
+
+    TRY(cp = wait_any({client.get(), &queue}, 1s));
+    TEST_EQUAL(cp, client.get());
+    TEST(client->append(msg));
+    TEST_EQUAL(msg, "hello");
+
+    TRY(t.join());
+    TRY(cp = wait_any({client.get(), &queue}, 1s));
+    TEST_EQUAL(cp, client.get());
+    TEST_EQUAL(client->append(msg), 0u);
+    TEST(client->is_closed());
+
+}
@@ -2,14 +2,20 @@
 #include "rs-format/string.hpp"
 #include "rs-unit-test.hpp"
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <ostream>
 #include <random>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
 using namespace RS::Format;
 using namespace RS::IO;
@@ -74,6 +80,32 @@ void test_rs_io_thread_pool_class() {
 
 }
 
+void test_rs_io_thread_pool_placement() {
+
+    static constexpr int n = 1000;
+
+    for (auto flags: {ThreadPool::flag::numa, ThreadPool::flag::pin, ThreadPool::flag::numa | ThreadPool::flag::pin}) {
+
+        ThreadPool pool(4, flags);
+        std::atomic<int> count(0);
+
+        TEST_EQUAL(pool.threads(), 4);
+        TEST(pool.nodes() >= 1);
+        TEST(pool.nodes() <= 4);
+
+        TRY(pool.each(n, [&] { ++count; }));
+        TEST(pool.wait_for(5s));
+        TEST_EQUAL(count.load(), n);
+
+        count = 0;
+        TRY(pool.each_chunk(n, [&] (int) { ++count; }));
+        TEST(pool.wait_for(5s));
+        TEST_EQUAL(count.load(), n);
+
+    }
+
+}
+
 void test_rs_io_thread_pool_each() {
 
     ThreadPool pool;
@@ -152,6 +184,473 @@ void test_rs_io_thread_pool_each() {
 
 }
 
+void test_rs_io_thread_pool_each_chunk() {
+
+    static constexpr int size = 100'000;
+
+    ThreadPool pool(4);
+    std::vector<int> v(size, 0);
+    std::atomic<int> chunks(0);
+
+    TRY(pool.each_chunk(size, [&] (int i) { ++v[i]; }));
+    TEST(pool.wait_for(5s));
+    TEST_EQUAL(std::count(v.begin(), v.end(), 1), size);
+
+    TRY(pool.each_chunk(0, size, 1000, [&] (int i, int j) {
+        TEST(j - i <= 1000);
+        for (; i < j; ++i)
+            ++v[i];
+        ++chunks;
+    }));
+    TEST(pool.wait_for(5s));
+    TEST_EQUAL(std::count(v.begin(), v.end(), 2), size);
+    TEST(chunks >= size / 1000);
+    TEST(chunks <= 2 * size / 1000);
+
+    chunks = 0;
+    TRY(pool.each_chunk(10, 10, 1, [&] (int /*i*/) { ++chunks; }));
+    TRY(pool.each_chunk(10, 5, 1, [&] (int /*i*/) { ++chunks; }));
+    TEST(pool.wait_for(5s));
+    TEST_EQUAL(chunks.load(), 0);
+
+}
+
+void test_rs_io_thread_pool_futures() {
+
+    ThreadPool pool;
+    Future<int> fi;
+    Future<std::string> fs;
+    Future<void> fv;
+    std::atomic<int> count(0);
+    int i = 0;
+    std::string s;
+
+    TEST(! fi.valid());
+    TRY(fi = pool.submit([] { return 42; }));
+    TEST(fi.valid());
+    TEST(fi.wait_for(5s));
+    TEST(fi.poll());
+    TRY(i = fi.get());
+    TEST_EQUAL(i, 42);
+    TEST(! fi.valid());
+    TEST_THROW(fi.get(), std::future_error);
+
+    TRY(fv = pool.submit([&] { ++count; }));
+    TRY(fv.get());
+    TEST_EQUAL(count.load(), 1);
+
+    Future<std::string> copy;
+    TRY(fs = pool.submit([] { return std::string("Hello"); }));
+    TRY(copy = fs);
+    TRY(s = copy.get());
+    TEST_EQUAL(s, "Hello");
+    TEST(fs.valid());
+    TEST_THROW(fs.get(), std::future_error);
+
+    TRY(fi = pool.submit([] () -> int { throw std::runtime_error("Test"); }));
+    TEST_THROW(fi.get(), std::runtime_error);
+
+    TRY(fs = pool.submit([] { return 42; })
+        .then([] (int n) { return n + 1; })
+        .then([] (int n) { return std::to_string(n); }));
+    TRY(s = fs.get());
+    TEST_EQUAL(s, "43");
+
+    count = 0;
+    TRY(fs = pool.submit([] () -> int { throw std::runtime_error("Test"); })
+        .then([&] (int n) { ++count; return std::to_string(n); }));
+    TEST_THROW(fs.get(), std::runtime_error);
+    TEST_EQUAL(count.load(), 0);
+
+    count = 0;
+    TRY(fv = pool.submit([&] { ++count; }).then([&] { ++count; }));
+    TRY(fv.get());
+    TEST_EQUAL(count.load(), 2);
+
+    TRY(pool.insert([] { throw std::runtime_error("Test"); }));
+    TEST(pool.wait_for(5s));
+
+}
+
+void test_rs_io_thread_pool_broken_futures() {
+
+    ThreadPool pool(1);
+    Future<int> fi;
+
+    TRY(pool.insert([] { std::this_thread::sleep_for(100ms); }));
+    std::this_thread::sleep_for(20ms);
+    TRY(fi = pool.submit([] { return 42; }));
+    TRY(pool.clear());
+    TEST(fi.poll());
+    TEST_THROW(fi.get(), std::future_error);
+
+}
+
+void test_rs_io_thread_pool_move_only() {
+
+    ThreadPool pool(2);
+    std::atomic<int> sum(0);
+    auto up = std::make_unique<int>(42);
+    std::array<int, 100> big;
+    Future<int> fi;
+
+    for (int i = 0; i < 100; ++i)
+        big[i] = i;
+
+    TRY(pool.insert([&sum,p=std::move(up)] { sum += *p; }));
+    TEST(pool.wait_for(1s));
+    TEST_EQUAL(sum.load(), 42);
+
+    TRY(pool.insert([&sum,big] { for (auto i: big) sum += i; }));
+    TEST(pool.wait_for(1s));
+    TEST_EQUAL(sum.load(), 4992);
+
+    up = std::make_unique<int>(86);
+    TRY(fi = pool.submit([p=std::move(up)] { return *p; }));
+    TRY(fi = fi.then([p=std::make_unique<int>(99)] (int x) { return x + *p; }));
+    TEST_EQUAL(fi.get(), 185);
+
+}
+
+void test_rs_io_thread_pool_priority() {
+
+    ThreadPool pool(1);
+    std::string log;
+    auto now = ThreadPool::clock::now();
+
+    TRY(pool.insert([] { std::this_thread::sleep_for(100ms); }));
+    std::this_thread::sleep_for(20ms);
+
+    TRY(pool.insert(ThreadPool::priority::low, [&log] { log += 'a'; }));
+    TRY(pool.insert([&log] { log += 'b'; }));
+    TRY(pool.insert(ThreadPool::priority::high, [&log] { log += 'c'; }));
+    TRY(pool.insert(now + 2s, [&log] { log += 'd'; }));
+    TRY(pool.insert(now + 1s, [&log] { log += 'e'; }));
+    TRY(pool.insert(ThreadPool::priority::high, [&log] { log += 'f'; }));
+
+    TEST_EQUAL(pool.queue_depth(ThreadPool::priority::high), 2);
+    TEST_EQUAL(pool.queue_depth(ThreadPool::priority::normal), 1);
+    TEST_EQUAL(pool.queue_depth(ThreadPool::priority::low), 1);
+    TEST_EQUAL(pool.deadline_depth(), 2);
+
+    TEST(pool.wait_for(1s));
+    TEST_EQUAL(log, "edcfba");
+    TEST_EQUAL(pool.queue_depth(ThreadPool::priority::high), 0);
+    TEST_EQUAL(pool.queue_depth(ThreadPool::priority::normal), 0);
+    TEST_EQUAL(pool.queue_depth(ThreadPool::priority::low), 0);
+    TEST_EQUAL(pool.deadline_depth(), 0);
+
+    // Low priority jobs still run while the high lane is busy
+
+    log.clear();
+    TRY(pool.insert([] { std::this_thread::sleep_for(100ms); }));
+    std::this_thread::sleep_for(20ms);
+    TRY(pool.insert(ThreadPool::priority::low, [&log] { log += 'z'; }));
+    for (int i = 0; i < 50; ++i)
+        TRY(pool.insert(ThreadPool::priority::high, [&log] { log += 'a'; }));
+    TEST(pool.wait_for(1s));
+    TEST_EQUAL(log.size(), 51u);
+    TEST(log.find('z') < 40);
+
+    TRY(pool.insert([] { std::this_thread::sleep_for(100ms); }));
+    std::this_thread::sleep_for(20ms);
+    TRY(pool.insert(ThreadPool::priority::low, [] {}));
+    TRY(pool.insert(now, [] {}));
+    TRY(pool.clear());
+    TEST(pool.poll());
+    TEST_EQUAL(pool.queue_depth(ThreadPool::priority::low), 0);
+    TEST_EQUAL(pool.deadline_depth(), 0);
+
+}
+
+void test_rs_io_thread_pool_stats() {
+
+    using histogram = ThreadPool::histogram;
+
+    static constexpr int n = 100;
+
+    TEST_EQUAL(histogram::bucket(0), 0);
+    TEST_EQUAL(histogram::bucket(7), 7);
+    TEST_EQUAL(histogram::bucket(8), 8);
+    TEST_EQUAL(histogram::bucket(15), 15);
+    TEST_EQUAL(histogram::bucket(16), 16);
+    TEST_EQUAL(histogram::bucket(17), 16);
+    TEST_EQUAL(histogram::bucket(18), 17);
+    TEST_EQUAL(histogram::bucket(~ uint64_t(0)), histogram::buckets - 1);
+    TEST_EQUAL(histogram::lower_bound(16), 16u);
+    TEST_EQUAL(histogram::upper_bound(16), 17u);
+    TEST_EQUAL(histogram::upper_bound(histogram::buckets - 1), ~ uint64_t(0));
+
+    for (int i = 0; i < histogram::buckets; ++i) {
+        TEST_EQUAL(histogram::bucket(histogram::lower_bound(i)), i);
+        TEST_EQUAL(histogram::bucket(histogram::upper_bound(i)), i);
+    }
+
+    {
+        ThreadPool pool(2);
+        TRY(pool.each(n, [] {}));
+        TEST(pool.wait_for(1s));
+        auto st = pool.stats();
+        TEST_EQUAL(st.workers.size(), 2u);
+        TEST_EQUAL(st.workers[0].jobs + st.workers[1].jobs, 0u);
+        TEST_EQUAL(st.queue_latency.count(), 0u);
+        TEST_EQUAL(st.run_time.percentile(50).count(), 0);
+    }
+
+    {
+        ThreadPool pool(2, ThreadPool::flag::stats);
+        TRY(pool.each(n, [] { std::this_thread::sleep_for(1ms); }));
+        TEST(pool.wait_for(5s));
+        auto st = pool.stats();
+        uint64_t jobs = st.helper_jobs;
+        for (auto& ws: st.workers)
+            jobs += ws.jobs;
+        TEST_EQUAL(jobs, uint64_t(n));
+        TEST_EQUAL(st.queue_latency.count(), uint64_t(n));
+        TEST_EQUAL(st.run_time.count(), uint64_t(n));
+        TEST(st.run_time.percentile(50) >= 1ms);
+        TEST(st.run_time.percentile(50) <= st.run_time.percentile(99));
+        TEST(st.run_time.percentile(99) <= st.run_time.max());
+        TEST(st.run_time.mean() >= 1ms);
+        TEST(st.queue_latency.percentile(99) <= st.queue_latency.max());
+        std::cout << "... Queue latency: p50 = " << duration_cast<microseconds>(st.queue_latency.percentile(50)).count()
+            << " us, p99 = " << duration_cast<microseconds>(st.queue_latency.percentile(99)).count() << " us" << std::endl;
+        std::cout << "... Run time: p50 = " << duration_cast<microseconds>(st.run_time.percentile(50)).count()
+            << " us, p99 = " << duration_cast<microseconds>(st.run_time.percentile(99)).count() << " us" << std::endl;
+    }
+
+}
+
+void test_rs_io_thread_pool_elastic() {
+
+    {
+        ThreadPool pool(3);
+        TEST_EQUAL(pool.threads(), 3);
+        TEST_EQUAL(pool.min_threads(), 3);
+        TEST_EQUAL(pool.max_threads(), 3);
+    }
+
+    ThreadPool pool(1, 4);
+    std::atomic<int> started(0);
+
+    TEST_EQUAL(pool.threads(), 1);
+    TEST_EQUAL(pool.min_threads(), 1);
+    TEST_EQUAL(pool.max_threads(), 4);
+    TRY(pool.set_block_threshold(10ms));
+    TRY(pool.set_idle_timeout(100ms));
+
+    // Each job blocks until all four have started, which can only happen if
+    // the pool grows
+
+    auto job = [&] {
+        ++started;
+        for (int i = 0; i < 500 && started < 4; ++i)
+            std::this_thread::sleep_for(10ms);
+    };
+
+    for (int i = 0; i < 4; ++i)
+        TRY(pool.insert(job));
+    TEST(pool.wait_for(10s));
+    TEST_EQUAL(started.load(), 4);
+    TEST_EQUAL(pool.threads(), 4);
+
+    for (int i = 0; i < 100 && pool.threads() > 1; ++i)
+        std::this_thread::sleep_for(20ms);
+    TEST_EQUAL(pool.threads(), 1);
+
+    std::atomic<int> count(0);
+    TRY(pool.each(100, [&] { ++count; }));
+    TEST(pool.wait_for(1s));
+    TEST_EQUAL(count.load(), 100);
+
+}
+
+void test_rs_io_thread_pool_nested() {
+
+    static constexpr int depth = 12;
+    static constexpr int expect = (1 << (depth + 1)) - 1;
+
+    ThreadPool pool(4);
+    std::atomic<int> count(0);
+    std::function<void(int)> f;
+
+    f = [&] (int n) {
+        ++count;
+        if (n > 0) {
+            pool.insert([&f,n] { f(n - 1); });
+            pool.insert([&f,n] { f(n - 1); });
+        }
+    };
+
+    TRY(pool.insert([&f] { f(depth); }));
+    TEST(pool.wait_for(5s));
+    TEST_EQUAL(count.load(), expect);
+
+    count = 0;
+    TRY(pool.insert([&f] { f(depth); }));
+    TRY(pool.clear());
+    TEST(count.load() <= expect);
+    TEST(pool.poll());
+
+}
+
+void test_rs_io_thread_pool_help() {
+
+    ThreadPool pool(1);
+    std::atomic<int> count(0), helped(0);
+    auto id = std::this_thread::get_id();
+
+    TRY(pool.insert([] { std::this_thread::sleep_for(200ms); }));
+    std::this_thread::sleep_for(50ms);
+
+    for (int i = 0; i < 10; ++i) {
+        TRY(pool.insert([&,id] {
+            ++count;
+            if (std::this_thread::get_id() == id)
+                ++helped;
+        }));
+    }
+
+    TRY(pool.wait(true));
+    TEST(pool.poll());
+    TEST_EQUAL(count.load(), 10);
+    TEST_EQUAL(helped.load(), 10);
+
+}
+
+void test_rs_io_thread_pool_task_group() {
+
+    ThreadPool pool(2);
+    TaskGroup slow(pool), fast(pool);
+    std::atomic<int> slow_count(0), fast_count(0);
+
+    for (int i = 0; i < 2; ++i)
+        TRY(slow.insert([&] { std::this_thread::sleep_for(200ms); ++slow_count; }));
+    std::this_thread::sleep_for(20ms);
+    for (int i = 0; i < 10; ++i)
+        TRY(fast.insert([&] { ++fast_count; }));
+
+    TEST(! fast.poll());
+    TEST(! slow.poll());
+    TEST(fast.wait_for(5s));
+    TEST_EQUAL(fast_count.load(), 10);
+    TEST(fast.poll());
+    TEST(slow.wait_for(5s));
+    TEST_EQUAL(slow_count.load(), 2);
+    TEST(pool.poll());
+
+    slow_count = fast_count = 0;
+    for (int i = 0; i < 2; ++i)
+        TRY(slow.insert([&] { std::this_thread::sleep_for(200ms); ++slow_count; }));
+    std::this_thread::sleep_for(20ms);
+    for (int i = 0; i < 10; ++i)
+        TRY(fast.insert([&] { ++fast_count; }));
+
+    TRY(fast.cancel());
+    TEST(fast.poll());
+    TEST_EQUAL(fast_count.load(), 0);
+    TEST(slow.wait_for(5s));
+    TEST_EQUAL(slow_count.load(), 2);
+
+    TRY(fast.insert([&] { ++fast_count; }));
+    TEST(fast.wait_for(5s));
+    TEST_EQUAL(fast_count.load(), 1);
+
+}
+
+void test_rs_io_thread_pool_strand() {
+
+    static constexpr int producers = 4;
+    static constexpr int count = 100'000;
+
+    ThreadPool pool(4);
+    Strand strand(pool);
+    std::vector<int> seen;
+    std::vector<std::vector<int>> by_producer(producers);
+    std::atomic<int> inside(0), overlaps(0);
+
+    TEST(&strand.pool() == &pool);
+    TEST(strand.poll());
+
+    for (int i = 0; i < 1000; ++i)
+        TRY(strand.insert([&,i] { seen.push_back(i); }));
+    TEST(strand.wait_for(5s));
+    TEST(strand.poll());
+    TEST_EQUAL(seen.size(), 1000u);
+    bool ordered = true;
+    for (int i = 0; i < int(seen.size()); ++i)
+        ordered &= seen[i] == i;
+    TEST(ordered);
+
+    // Tasks inserted from inside the strand run after the current one
+    seen.clear();
+    TRY(strand.insert([&] {
+        strand.insert([&] { seen.push_back(2); });
+        seen.push_back(1);
+    }));
+    TEST(strand.wait_for(5s));
+    TEST(seen == (std::vector<int>{1, 2}));
+
+    auto start = system_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&,p] {
+            for (int i = 0; i < count; ++i) {
+                strand.insert([&,p,i] {
+                    if (++inside > 1)
+                        ++overlaps;
+                    by_producer[p].push_back(i);
+                    --inside;
+                });
+            }
+        });
+    }
+    for (auto& t: threads)
+        t.join();
+    TEST(strand.wait_for(10s));
+    auto stop = system_clock::now();
+    TEST_EQUAL(overlaps.load(), 0);
+    for (int p = 0; p < producers; ++p) {
+        TEST_EQUAL(int(by_producer[p].size()), count);
+        ordered = true;
+        for (int i = 0; i < int(by_producer[p].size()); ++i)
+            ordered &= by_producer[p][i] == i;
+        TEST(ordered);
+    }
+
+    double rate = producers * count / duration<double>(stop - start).count();
+    std::cout << "... Strand throughput = " << int(rate) << " tasks/s" << std::endl;
+
+}
+
+void test_rs_io_thread_pool_strand_clear() {
+
+    ThreadPool pool(1);
+    Strand strand(pool);
+    std::atomic<bool> release(false);
+    std::atomic<int> calls(0);
+
+    // Block the only worker so the strand's drain job is still queued
+    TRY(pool.insert([&] { while (! release) std::this_thread::sleep_for(1ms); }));
+    std::this_thread::sleep_for(20ms);
+    for (int i = 0; i < 10; ++i)
+        TRY(strand.insert([&] { ++calls; }));
+    TEST(! strand.poll());
+    std::thread releaser([&] {
+        std::this_thread::sleep_for(50ms);
+        release = true;
+    });
+    TRY(pool.clear());
+    releaser.join();
+    TEST(strand.poll());
+    TEST_EQUAL(calls.load(), 0);
+
+    TRY(strand.insert([&] { ++calls; }));
+    TEST(strand.wait_for(5s));
+    TEST_EQUAL(calls.load(), 1);
+
+}
+
 void test_rs_io_thread_pool_timing() {
 
     static constexpr int iterations = 100'000;
@@ -170,4 +669,56 @@ void test_rs_io_thread_pool_timing() {
     double rate = 1e9 / each;
     std::cout << "... Calls per second = " << uint64_t(rate) << std::endl;
 
+    static constexpr int size = 1'000'000;
+
+    std::vector<double> v(size, 1.0);
+    auto loop = [&v] (int i) { v[i] = v[i] * 1.5 + 0.5; };
+
+    start = system_clock::now();
+    TRY(pool.each(size, loop));
+    TEST(pool.wait_for(10s));
+    stop = system_clock::now();
+    auto each_time = duration_cast<microseconds>(stop - start).count();
+
+    start = system_clock::now();
+    TRY(pool.each_chunk(size, loop));
+    TEST(pool.wait_for(10s));
+    stop = system_clock::now();
+    auto chunk_time = duration_cast<microseconds>(stop - start).count();
+
+    std::cout << "... each() over " << size << " elements = " << each_time << " us" << std::endl;
+    std::cout << "... each_chunk() over " << size << " elements = " << chunk_time << " us" << std::endl;
+
+}
+
+void test_rs_io_thread_pool_latency() {
+
+    static constexpr int iterations = 100;
+
+    ThreadPool pool;
+    std::atomic<int64_t> total(0);
+
+    for (int i = 0; i < iterations; ++i) {
+        std::this_thread::sleep_for(1ms);
+        auto start = system_clock::now();
+        TRY(pool.insert([&total,start] {
+            auto stop = system_clock::now();
+            total += duration_cast<nanoseconds>(stop - start).count();
+        }));
+        TEST(pool.wait_for(5s));
+    }
+
+    double each = double(total) / double(iterations);
+    std::cout << "... Mean submit-to-start latency = " << uint64_t(each / 1000) << " us" << std::endl;
+
+    auto start = system_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        TRY(pool.insert([] {}));
+        TRY(pool.wait());
+    }
+    auto stop = system_clock::now();
+
+    each = double(duration_cast<nanoseconds>(stop - start).count()) / double(iterations);
+    std::cout << "... Mean insert-to-wait latency = " << uint64_t(each / 1000) << " us" << std::endl;
+
 }
@@ -0,0 +1,222 @@
+#include "rs-io/timer-wheel.hpp"
+#include "rs-unit-test.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace RS::IO;
+using namespace std::chrono;
+using namespace std::literals;
+
+void test_rs_io_timer_wheel_manual() {
+
+    TimerWheel wheel(10us);
+    std::vector<int> fired;
+    TimerWheel::timer t1([&] { fired.push_back(1); });
+    TimerWheel::timer t2([&] { fired.push_back(2); });
+    TimerWheel::timer t3([&] { fired.push_back(3); });
+    TimerWheel::timer t4([&] { fired.push_back(4); });
+    size_t n = 0;
+
+    TEST(wheel.empty());
+    TEST(wheel.resolution() == 10us);
+    TEST(wheel.next_timeout() == TimerWheel::duration::max());
+    TRY(n = wheel.advance());
+    TEST_EQUAL(n, 0u);
+
+    TRY(t1.arm(wheel, 1ms));     // Level 1
+    TRY(t2.arm(wheel, 50ms));    // Level 2
+    TRY(t3.arm(wheel, 100us));   // Level 0
+    TRY(t4.arm(wheel, 2ms));
+    TEST_EQUAL(wheel.size(), 4u);
+    TEST(t4.is_armed());
+    TEST(t4.cancel());
+    TEST(! t4.is_armed());
+    TEST(! t4.cancel());
+    TEST_EQUAL(wheel.size(), 3u);
+    TEST(wheel.next_timeout() <= 110us);
+
+    std::this_thread::sleep_for(5ms);
+    TRY(n = wheel.advance());
+    TEST_EQUAL(n, 2u);
+    TEST_EQUAL(fired.size(), 2u);
+    TEST(fired == (std::vector<int>{3, 1}));
+    TEST(! t1.is_armed());
+    TEST(t2.is_armed());
+    TEST_EQUAL(wheel.size(), 1u);
+
+    TRY(t1.arm(wheel, 10ms));
+    TRY(t2.arm(wheel, 200ms));
+    TEST(wheel.next_timeout() <= 10010us);
+    std::this_thread::sleep_for(60ms);
+    TRY(n = wheel.advance());
+    TEST_EQUAL(n, 1u);
+    TEST(fired == (std::vector<int>{3, 1, 1}));
+    TEST(t2.is_armed());
+    TEST(t2.cancel());
+    TEST(wheel.empty());
+
+}
+
+void test_rs_io_timer_wheel_accuracy() {
+
+    static constexpr int count = 10'000;
+
+    TimerWheel wheel(100us);
+    std::vector<std::unique_ptr<TimerWheel::timer>> timers;
+    std::vector<TimerWheel::time_point> due(count), fired(count);
+    std::atomic<int> done(0);
+
+    TRY(wheel.start());
+    auto start = TimerWheel::clock::now();
+    for (int i = 0; i < count; ++i) {
+        auto delay = microseconds(20'000 + 7919 * i % 50'000);
+        due[i] = TimerWheel::clock::now() + delay;
+        timers.push_back(std::make_unique<TimerWheel::timer>([&,i] {
+            fired[i] = TimerWheel::clock::now();
+            ++done;
+        }));
+        TRY(timers.back()->arm(wheel, duration_cast<TimerWheel::duration>(delay)));
+        if (i % 3 == 0)
+            TEST(timers.back()->cancel());
+    }
+    auto armed = TimerWheel::clock::now();
+
+    int expect = count - (count + 2) / 3;
+    for (int i = 0; i < 200 && done < expect; ++i)
+        std::this_thread::sleep_for(5ms);
+    TEST_EQUAL(done, expect);
+    TEST(wheel.empty());
+
+    int early = 0;
+    for (int i = 0; i < count; ++i)
+        if (i % 3 != 0 && fired[i] < due[i])
+            ++early;
+    TEST_EQUAL(early, 0);
+    TRY(wheel.stop());
+
+    double ns = duration<double, std::nano>(armed - start).count() / count;
+    std::cout << "... TimerWheel arm/cancel time = " << int(ns) << " ns" << std::endl;
+
+}
+
+void test_rs_io_timer_wheel_rearm() {
+
+    TimerWheel wheel(100us);
+    std::atomic<int> ticks(0);
+    TimerWheel::timer t;
+
+    TRY(t.set_callback([&] {
+        if (++ticks < 5)
+            t.arm(wheel, 1ms);
+    }));
+    TRY(wheel.start());
+    TRY(t.arm(wheel, 1ms));
+    for (int i = 0; i < 200 && ticks < 5; ++i)
+        std::this_thread::sleep_for(2ms);
+    TEST_EQUAL(ticks, 5);
+    TEST(! t.is_armed());
+
+    // Rearming pushes the timer out
+    ticks = 10;
+    TRY(t.arm(wheel, 20ms));
+    std::this_thread::sleep_for(10ms);
+    TRY(t.arm(wheel, 50ms));
+    std::this_thread::sleep_for(20ms);
+    TEST_EQUAL(ticks, 10);
+    TEST(t.is_armed());
+    TRY(wheel.stop());
+    TEST(t.is_armed());
+
+}
+
+void test_rs_io_timer_wheel_cancel_while_firing() {
+
+    // Another thread's callback finishing must not let cancel() return
+    // while this timer's callback is still running
+
+    TimerWheel wheel(100us);
+    std::atomic<bool> started(false), finished(false);
+    TimerWheel::timer slow([&] {
+        started = true;
+        std::this_thread::sleep_for(50ms);
+        finished = true;
+    });
+    TimerWheel::timer quick([] {});
+
+    TRY(slow.arm(wheel, 1ms));
+    std::this_thread::sleep_for(5ms);
+    std::thread driver([&] { wheel.advance(); });
+    while (! started)
+        std::this_thread::sleep_for(1ms);
+    TRY(quick.arm(wheel, 1ms));
+    std::this_thread::sleep_for(5ms);
+    TEST_EQUAL(wheel.advance(), 1u);
+    TEST(! slow.cancel());
+    TEST(finished);
+    driver.join();
+
+}
+
+void test_rs_io_timer_wheel_self_destroy() {
+
+    TimerWheel wheel(100us);
+    auto token = std::make_shared<int>(42);
+    std::atomic<int> calls(0);
+
+    // One-shot timers that delete themselves from their own callbacks
+
+    for (int i = 0; i < 10; ++i) {
+        auto t = new TimerWheel::timer;
+        TRY(t->set_callback([&calls,t,token] {
+            ++calls;
+            delete t;
+        }));
+        TRY(t->arm(wheel, 1ms));
+    }
+    TEST_EQUAL(token.use_count(), 11);
+    std::this_thread::sleep_for(5ms);
+    TEST_EQUAL(wheel.advance(), 10u);
+    TEST_EQUAL(calls.load(), 10);
+    TEST_EQUAL(token.use_count(), 1);
+    TEST(wheel.empty());
+
+    calls = 0;
+    TRY(wheel.start());
+    for (int i = 0; i < 10; ++i) {
+        auto t = std::make_shared<TimerWheel::timer>();
+        auto tp = t.get();
+        TRY(tp->set_callback([&calls,t=std::move(t),token] () mutable {
+            ++calls;
+            t.reset();
+        }));
+        TRY(tp->arm(wheel, 1ms));
+    }
+    for (int i = 0; i < 200 && calls < 10; ++i)
+        std::this_thread::sleep_for(1ms);
+    TRY(wheel.stop());
+    TEST_EQUAL(calls.load(), 10);
+    TEST_EQUAL(token.use_count(), 1);
+
+    // Cancelling and rearming from the callback keeps the callback
+
+    TimerWheel::timer t;
+    calls = 0;
+    TRY(t.set_callback([&] {
+        if (++calls == 1) {
+            t.cancel();
+            t.arm(wheel, 1ms);
+        }
+    }));
+    TRY(t.arm(wheel, 1ms));
+    for (int i = 0; i < 2; ++i) {
+        std::this_thread::sleep_for(5ms);
+        TEST_EQUAL(wheel.advance(), 1u);
+    }
+    TEST_EQUAL(calls.load(), 2);
+    TEST(! t.is_armed());
+
+}
@@ -42,12 +42,32 @@ int main(int argc, char** argv) {
     UNIT_TEST(rs_io_stdio_anonymous_temporary_file)
     UNIT_TEST(rs_io_stdio_named_temporary_file)
 
+    // timer-wheel-test.cpp
+    UNIT_TEST(rs_io_timer_wheel_manual)
+    UNIT_TEST(rs_io_timer_wheel_accuracy)
+    UNIT_TEST(rs_io_timer_wheel_rearm)
+    UNIT_TEST(rs_io_timer_wheel_cancel_while_firing)
+    UNIT_TEST(rs_io_timer_wheel_self_destroy)
+
     // channel-classes-test.cpp
     UNIT_TEST(rs_io_channel_generator)
     UNIT_TEST(rs_io_channel_buffer)
+    UNIT_TEST(rs_io_channel_buffer_spans)
+    UNIT_TEST(rs_io_channel_buffer_streaming)
     UNIT_TEST(rs_io_channel_queue)
+    UNIT_TEST(rs_io_channel_queue_batch)
     UNIT_TEST(rs_io_channel_value)
     UNIT_TEST(rs_io_channel_timer)
+    UNIT_TEST(rs_io_channel_bounded_queue)
+    UNIT_TEST(rs_io_channel_bounded_queue_threads)
+    UNIT_TEST(rs_io_channel_bounded_queue_throwing)
+    UNIT_TEST(rs_io_channel_spsc_queue)
+    UNIT_TEST(rs_io_channel_spsc_queue_throughput)
+    UNIT_TEST(rs_io_channel_broadcast)
+    UNIT_TEST(rs_io_channel_broadcast_block)
+    UNIT_TEST(rs_io_channel_broadcast_disconnect)
+    UNIT_TEST(rs_io_channel_wait_any)
+    UNIT_TEST(rs_io_channel_wait_any_latency)
 
     // channel-dispatch-test.cpp
     UNIT_TEST(rs_io_channel_dispatch_empty)
@@ -61,6 +81,23 @@ int main(int argc, char** argv) {
     UNIT_TEST(rs_io_channel_dispatch_heterogeneous_async_exception)
     UNIT_TEST(rs_io_channel_dispatch_async_message_channel)
     UNIT_TEST(rs_io_channel_dispatch_async_stream_channel)
+    UNIT_TEST(rs_io_channel_dispatch_reactor_message_channel)
+    UNIT_TEST(rs_io_channel_dispatch_reactor_stream_channel)
+    UNIT_TEST(rs_io_channel_dispatch_reactor_heterogeneous)
+    UNIT_TEST(rs_io_channel_dispatch_reactor_stop)
+    UNIT_TEST(rs_io_channel_dispatch_bounded_queue)
+    UNIT_TEST(rs_io_channel_dispatch_notify_lifetime)
+    UNIT_TEST(rs_io_channel_dispatch_spsc_queue)
+    UNIT_TEST(rs_io_channel_dispatch_broadcast)
+    UNIT_TEST(rs_io_channel_dispatch_timer_wheel)
+    UNIT_TEST(rs_io_channel_dispatch_pool_serial)
+    UNIT_TEST(rs_io_channel_dispatch_pool_concurrent)
+    UNIT_TEST(rs_io_channel_dispatch_pool_exception)
+    UNIT_TEST(rs_io_channel_dispatch_pool_clear)
+    UNIT_TEST(rs_io_channel_dispatch_strand)
+    UNIT_TEST(rs_io_channel_dispatch_strand_drop)
+    UNIT_TEST(rs_io_channel_dispatch_batch)
+    UNIT_TEST(rs_io_channel_dispatch_latency)
 
     // net-address-test.cpp
     UNIT_TEST(rs_io_net_ipv4)
@@ -74,6 +111,10 @@ int main(int argc, char** argv) {
     // net-tcp-test.cpp
     UNIT_TEST(rs_io_net_tcp_client_server)
     UNIT_TEST(rs_io_net_socket_set)
+    UNIT_TEST(rs_io_net_socket_set_many)
+    UNIT_TEST(rs_io_net_socket_set_events)
+    UNIT_TEST(rs_io_net_tcp_dispatch)
+    UNIT_TEST(rs_io_net_tcp_wait_any)
 
     // process-test.cpp
     UNIT_TEST(rs_io_process_stream)
@@ -89,8 +130,29 @@ int main(int argc, char** argv) {
 
     // thread-pool-test.cpp
     UNIT_TEST(rs_io_thread_pool_class)
+    UNIT_TEST(rs_io_thread_pool_placement)
     UNIT_TEST(rs_io_thread_pool_each)
+    UNIT_TEST(rs_io_thread_pool_each_chunk)
+    UNIT_TEST(rs_io_thread_pool_futures)
+    UNIT_TEST(rs_io_thread_pool_broken_futures)
+    UNIT_TEST(rs_io_thread_pool_move_only)
+    UNIT_TEST(rs_io_thread_pool_priority)
+    UNIT_TEST(rs_io_thread_pool_stats)
+    UNIT_TEST(rs_io_thread_pool_elastic)
+    UNIT_TEST(rs_io_thread_pool_nested)
+    UNIT_TEST(rs_io_thread_pool_help)
+    UNIT_TEST(rs_io_thread_pool_task_group)
+    UNIT_TEST(rs_io_thread_pool_strand)
+    UNIT_TEST(rs_io_thread_pool_strand_clear)
     UNIT_TEST(rs_io_thread_pool_timing)
+    UNIT_TEST(rs_io_thread_pool_latency)
+
+    // coroutine-test.cpp
+    UNIT_TEST(rs_io_coroutine_task)
+    UNIT_TEST(rs_io_coroutine_spawn_discarded)
+    UNIT_TEST(rs_io_coroutine_channels)
+    UNIT_TEST(rs_io_coroutine_native_handle)
+    UNIT_TEST(rs_io_coroutine_latency)
 
     // uri-schemes-test.cpp
     UNIT_TEST(rs_io_uri_parse_http)